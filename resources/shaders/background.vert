@@ -1,8 +1,12 @@
-#version 330 core
+#version 430 core
 layout(location = 0) in vec3 aPos;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout(std140, binding = 0) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 camPos;
+};
 
 out vec3 WorldPos;
 
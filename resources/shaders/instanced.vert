@@ -1,15 +1,64 @@
-#version 330 core
+#version 430 core
 layout(location = 0) in vec3 aPos;
 layout(location = 2) in vec2 aTexCoords;
-layout(location = 3) in mat4 aInstanceMatrix;
+// quantized positions are stored within the mesh bounds, one entry per draw, see GeometryPool
+layout(location = 3) in vec3 aPositionScale;
+layout(location = 4) in vec3 aPositionOffset;
 
 out vec2 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout(std140, binding = 0) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 camPos;
+};
+
+// all instances and the indices of the ones that survived culling, see instance_cull.comp
+// packed InstanceData from instance_culler.h, 5 uints per instance
+layout(std430, binding = 5) readonly buffer InstanceBuffer
+{
+    uint instanceData[];
+};
+
+struct Instance {
+    vec3 position;
+    vec4 rotation;
+    float scale;
+};
+
+Instance loadInstance(uint index)
+{
+    uint base = index * 5u;
+    Instance instance;
+    instance.position = uintBitsToFloat(uvec3(instanceData[base], instanceData[base + 1u], instanceData[base + 2u]));
+    vec2 rotationXY = unpackSnorm2x16(instanceData[base + 3u]);
+    float rotationZ = unpackSnorm2x16(instanceData[base + 4u]).x;
+    // w was made positive before packing
+    float rotationW = sqrt(max(1.0 - dot(rotationXY, rotationXY) - rotationZ * rotationZ, 0.0));
+    instance.rotation = vec4(rotationXY, rotationZ, rotationW);
+    instance.scale = unpackHalf2x16(instanceData[base + 4u]).y;
+    return instance;
+}
+
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+layout(std430, binding = 6) readonly buffer VisibleInstanceBuffer
+{
+    uint visibleInstances[];
+};
+
+// start of the list of the level of detail drawn, see InstanceCuller::draw()
+uniform int visibleOffset = 0;
 
 void main()
 {
+    vec3 position = aPos * aPositionScale + aPositionOffset;
+    Instance instance = loadInstance(visibleInstances[visibleOffset + gl_InstanceID]);
+    vec3 worldPos = instance.position + rotate(instance.rotation, position * instance.scale);
     TexCoords = aTexCoords;
-    gl_Position = projection * view * aInstanceMatrix * vec4(aPos, 1.0f);
+    gl_Position = projection * view * vec4(worldPos, 1.0f);
 }
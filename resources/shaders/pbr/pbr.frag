@@ -0,0 +1,530 @@
+#version 430 core
+// defined by MaterialSystem::getShaderDefines() when the CPU side uses bindless handles
+#ifdef MATERIALS_BINDLESS
+#extension GL_ARB_bindless_texture : require
+#endif
+out vec4 FragColor;
+in vec2 TexCoords;
+in vec3 WorldPos;
+in vec3 Normal;
+flat in uint MaterialIndex;
+
+// material parameters, one entry per material, see MaterialSystem
+#define ALBEDO_MAP 0
+#define NORMAL_MAP 1
+#define METALLIC_MAP 2
+#define ROUGHNESS_MAP 3
+#define AO_MAP 4
+#define EMISSION_MAP 5
+
+struct Material {
+    // a bindless handle, or the texture array and layer
+    uvec2 textures[6];
+    int packing;
+    uint mapMask;
+};
+
+layout(std430, binding = 9) readonly buffer MaterialBuffer
+{
+    Material materials[];
+};
+
+#ifndef MATERIALS_BINDLESS
+// one array per texture format and size, the index is the same for a whole draw
+#define MAX_MATERIAL_ARRAYS 16
+uniform sampler2DArray materialArrays[MAX_MATERIAL_ARRAYS];
+#endif
+
+Material material;
+
+bool hasMap(int map)
+{
+    return (material.mapMask & (1u << map)) != 0u;
+}
+
+// fallback for materials without the map
+vec4 sampleMap(int map, vec4 fallback)
+{
+    if (!hasMap(map)) {
+        return fallback;
+    }
+    uvec2 location = material.textures[map];
+#ifdef MATERIALS_BINDLESS
+    return texture(sampler2D(location), TexCoords);
+#else
+    return texture(materialArrays[location.x], vec3(TexCoords, float(location.y)));
+#endif
+}
+
+uniform vec3 emission = vec3(0.0);
+
+// IBL, diffuse irradiance as L2 spherical harmonics with the basis constants folded in
+layout(std140, binding = 2) uniform Irradiance
+{
+    vec4 irradianceSH[9];
+};
+uniform samplerCube prefilterMap;
+uniform sampler2D brdfLUT;
+
+layout(std140, binding = 0) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 camPos;
+};
+
+uniform bool isRefractive;
+
+uniform float ambientIntensity;
+
+// directional shadows, one layer per cascade
+#define MAX_SHADOWS 10
+#define MAX_CASCADES 4
+uniform sampler2DArray directionalShadowMaps;
+
+layout(std140, binding = 1) uniform Shadows
+{
+    mat4 directionalLightSpaceMatrices[MAX_SHADOWS];
+    vec4 cascadeSplits;
+    int cascadeCount;
+};
+
+// directional lights affect every fragment, so they aren't clustered
+struct DirectionalLight {
+    vec3 direction;
+    float intensity;
+    vec3 color;
+    int shadowIndex;
+};
+
+layout(std430, binding = 3) readonly buffer DirectionalLightBuffer
+{
+    DirectionalLight directionalLights[];
+};
+
+uniform int directionalLightCount;
+
+// spot and point light shadows share one atlas, point lights use six tiles in cube map face order
+uniform sampler2D shadowAtlas;
+
+struct ShadowTile {
+    mat4 lightSpaceMatrix;
+    vec4 rect;
+};
+
+layout(std430, binding = 4) readonly buffer ShadowTileBuffer
+{
+    ShadowTile shadowTiles[];
+};
+
+// clustered point and spot lights, layouts must match light_clusters.h
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+
+#define LIGHT_TYPE_POINT 0
+#define LIGHT_TYPE_SPOT 1
+
+struct Light {
+    vec3 position;
+    float range;
+    vec3 color;
+    float intensity;
+    vec3 direction;
+    int type;
+    float innerAngle;
+    float outerAngle;
+    int shadowIndex;
+    float padding;
+};
+
+layout(std430, binding = 0) readonly buffer LightBuffer
+{
+    Light lights[];
+};
+
+// x = offset into lightIndices, y = light count
+layout(std430, binding = 1) readonly buffer ClusterBuffer
+{
+    uvec2 clusters[];
+};
+
+layout(std430, binding = 2) readonly buffer LightIndexBuffer
+{
+    uint lightIndices[];
+};
+
+uniform vec2 clusterTileSize;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
+uniform bool showClusterHeatmap;
+
+const float PI = 3.14159265359;
+// ----------------------------------------------------------------------------
+vec3 evaluateIrradiance(vec3 n)
+{
+    vec3 irradiance = irradianceSH[0].rgb
+        + irradianceSH[1].rgb * n.y
+        + irradianceSH[2].rgb * n.z
+        + irradianceSH[3].rgb * n.x
+        + irradianceSH[4].rgb * (n.x * n.y)
+        + irradianceSH[5].rgb * (n.y * n.z)
+        + irradianceSH[6].rgb * (3.0 * n.z * n.z - 1.0)
+        + irradianceSH[7].rgb * (n.x * n.z)
+        + irradianceSH[8].rgb * (n.x * n.x - n.y * n.y);
+    // L2 rings slightly around very bright, small lights
+    return max(irradiance, vec3(0.0));
+}
+// ----------------------------------------------------------------------------
+// Easy trick to get tangent-normals to world-space to keep PBR code simplified.
+// Don't worry if you don't get what's going on; you generally want to do normal
+// mapping the usual way for performance anways; I do plan make a note of this
+// technique somewhere later in the normal mapping tutorial.
+vec3 getNormalFromMap()
+{
+    if (!hasMap(NORMAL_MAP)) {
+        return normalize(Normal);
+    }
+
+    // cooked normal maps are BC5 and only keep x and y
+    vec2 tangentXY = sampleMap(NORMAL_MAP, vec4(0.5, 0.5, 1.0, 1.0)).xy * 2.0 - 1.0;
+    vec3 tangentNormal = vec3(tangentXY, sqrt(max(1.0 - dot(tangentXY, tangentXY), 0.0)));
+
+    vec3 Q1 = dFdx(WorldPos);
+    vec3 Q2 = dFdy(WorldPos);
+    vec2 st1 = dFdx(TexCoords);
+    vec2 st2 = dFdy(TexCoords);
+
+    vec3 N = normalize(Normal);
+    vec3 T = normalize(Q1 * st2.t - Q2 * st1.t);
+    vec3 B = -normalize(cross(N, T));
+    mat3 TBN = mat3(T, B, N);
+
+    return normalize(TBN * tangentNormal);
+}
+// ----------------------------------------------------------------------------
+float DistributionGGX(vec3 N, vec3 H, float roughness)
+{
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float NdotH = max(dot(N, H), 0.0);
+    float NdotH2 = NdotH * NdotH;
+
+    float nom = a2;
+    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+    denom = PI * denom * denom;
+
+    return nom / denom;
+}
+// ----------------------------------------------------------------------------
+float GeometrySchlickGGX(float NdotV, float roughness)
+{
+    float r = (roughness + 1.0);
+    float k = (r * r) / 8.0;
+
+    float nom = NdotV;
+    float denom = NdotV * (1.0 - k) + k;
+
+    return nom / denom;
+}
+// ----------------------------------------------------------------------------
+float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
+{
+    float NdotV = max(dot(N, V), 0.0);
+    float NdotL = max(dot(N, L), 0.0);
+    float ggx2 = GeometrySchlickGGX(NdotV, roughness);
+    float ggx1 = GeometrySchlickGGX(NdotL, roughness);
+
+    return ggx1 * ggx2;
+}
+// ----------------------------------------------------------------------------
+vec3 fresnelSchlick(float cosTheta, vec3 F0)
+{
+    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+// ----------------------------------------------------------------------------
+vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
+{
+    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+// ----------------------------------------------------------------------------
+// Cook-Torrance BRDF for a single light, already multiplied by NdotL
+vec3 evaluateLight(vec3 N, vec3 V, vec3 L, vec3 radiance, vec3 albedo, float metallic, float roughness, vec3 F0)
+{
+    vec3 H = normalize(V + L);
+
+    float NDF = DistributionGGX(N, H, roughness);
+    float G = GeometrySmith(N, V, L, roughness);
+    vec3 F = fresnelSchlick(max(dot(H, V), 0.0), F0);
+
+    vec3 numerator = NDF * G * F;
+    float denominator = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + 0.0001; // + 0.0001 to prevent divide by zero
+    vec3 specular = numerator / denominator;
+
+    // kS is equal to Fresnel
+    vec3 kS = F;
+    // for energy conservation, the diffuse and specular light can't
+    // be above 1.0 (unless the surface emits light); to preserve this
+    // relationship the diffuse component (kD) should equal 1.0 - kS.
+    vec3 kD = vec3(1.0) - kS;
+    // multiply kD by the inverse metalness such that only non-metals
+    // have diffuse lighting, or a linear blend if partly metal (pure metals
+    // have no diffuse light).
+    kD *= 1.0 - metallic;
+
+    // scale light by NdotL
+    float NdotL = max(dot(N, L), 0.0);
+
+    // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
+    return (kD * albedo / PI + specular) * radiance * NdotL;
+}
+// ----------------------------------------------------------------------------
+// smoothly fades the light out to zero at its range, so clustering can drop it past that
+float rangeAttenuation(float distance, float range)
+{
+    float ratio = distance / range;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window / (distance * distance + 0.0001);
+}
+
+// PCF inside an atlas tile, samples are clamped so they never read a neighbouring tile.
+// depthScale undoes the mapping of linear depth to [0;1] for point lights.
+float AtlasShadowCalculation(ShadowTile tile, vec2 uv, float currentDepth, float depthScale, float bias)
+{
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    vec2 minUV = tile.rect.xy + texelSize * 0.5;
+    vec2 maxUV = tile.rect.xy + tile.rect.zw - texelSize * 0.5;
+    vec2 atlasUV = tile.rect.xy + uv * tile.rect.zw;
+
+    float shadow = 0.0;
+    for(int x = -1; x <= 1; ++x)
+    {
+        for(int y = -1; y <= 1; ++y)
+        {
+            float pcfDepth = texture(shadowAtlas, clamp(atlasUV + vec2(x, y) * texelSize, minUV, maxUV)).r * depthScale;
+            shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+        }
+    }
+    shadow /= 9.0;
+
+    return shadow;
+}
+
+float SpotShadowCalculation(int tileIndex, float bias)
+{
+    ShadowTile tile = shadowTiles[tileIndex];
+    vec4 worldPosLightSpace = tile.lightSpaceMatrix * vec4(WorldPos, 1.0);
+    vec3 projCoords = worldPosLightSpace.xyz / worldPosLightSpace.w * 0.5 + 0.5;
+
+    // outside of the tile there is no border to fall back to
+    if (any(lessThan(projCoords, vec3(0.0))) || any(greaterThan(projCoords, vec3(1.0)))) {
+        return 0.0;
+    }
+
+    return AtlasShadowCalculation(tile, projCoords.xy, projCoords.z, 1.0, bias);
+}
+
+float PointShadowCalculation(vec3 lightPos, float far_plane, int tileIndex)
+{
+    // get vector between fragment position and light position
+    vec3 fragToLight = WorldPos - lightPos;
+    // now get current linear depth as the length between the fragment and light position
+    float currentDepth = length(fragToLight);
+
+    // pick the cube face the same way cube map sampling does
+    vec3 absDir = abs(fragToLight);
+    int face;
+    if (absDir.x >= absDir.y && absDir.x >= absDir.z) {
+        face = fragToLight.x > 0.0 ? 0 : 1;
+    } else if (absDir.y >= absDir.z) {
+        face = fragToLight.y > 0.0 ? 2 : 3;
+    } else {
+        face = fragToLight.z > 0.0 ? 4 : 5;
+    }
+
+    ShadowTile tile = shadowTiles[tileIndex + face];
+    vec4 worldPosLightSpace = tile.lightSpaceMatrix * vec4(WorldPos, 1.0);
+    vec2 uv = worldPosLightSpace.xy / worldPosLightSpace.w * 0.5 + 0.5;
+
+    float bias = 0.15;
+    return AtlasShadowCalculation(tile, uv, currentDepth, far_plane, bias);
+}
+
+float ShadowCalculation(sampler2DArray shadow_maps, int layer, mat4 lightSpaceMatrix, float bias)
+{
+    vec4 worldPosLightSpace = lightSpaceMatrix * vec4(WorldPos, 1.0);
+    // perform perspective divide
+    vec3 projCoords = worldPosLightSpace.xyz / worldPosLightSpace.w;
+    // transform to [0,1] range
+    projCoords = projCoords * 0.5 + 0.5;
+    // get depth of current fragment from light's perspective
+    float currentDepth = projCoords.z;
+
+    float shadow = 0.0;
+    vec2 texelSize = 1.0 / textureSize(shadow_maps, 0).xy;
+    for(int x = -1; x <= 1; ++x)
+    {
+        for(int y = -1; y <= 1; ++y)
+        {
+            float pcfDepth = texture(shadow_maps, vec3(projCoords.xy + vec2(x, y) * texelSize, layer)).r;
+            shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+        }
+    }
+    shadow /= 9.0;
+
+    return shadow;
+}
+
+float DirectionalShadowCalculation(int shadowIndex, vec3 lightDir)
+{
+    // the first cascade whose slice still contains the fragment has the highest resolution
+    float viewDepth = -(view * vec4(WorldPos, 1.0)).z;
+    int cascade = 0;
+    while (cascade < cascadeCount && viewDepth > cascadeSplits[cascade]) {
+        cascade++;
+    }
+    if (cascade == cascadeCount) {
+        return 0.0;
+    }
+
+    int layer = shadowIndex + cascade;
+    float bias = max(0.01 * (1.0 - dot(Normal, lightDir)), 0.005);
+    return ShadowCalculation(directionalShadowMaps, layer, directionalLightSpaceMatrices[layer], bias);
+}
+// ----------------------------------------------------------------------------
+uint getClusterIndex()
+{
+    float viewDepth = -(view * vec4(WorldPos, 1.0)).z;
+    uint slice = uint(clamp(log(viewDepth) * clusterSliceScale + clusterSliceBias, 0.0, float(CLUSTER_GRID_Z - 1)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterTileSize), uvec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+    return tile.x + CLUSTER_GRID_X * (tile.y + CLUSTER_GRID_Y * slice);
+}
+// ----------------------------------------------------------------------------
+void main()
+{
+    // material properties
+    material = materials[MaterialIndex];
+    vec4 albedo2 = sampleMap(ALBEDO_MAP, vec4(1.0));
+
+    if (albedo2.a < 0.01) {
+        discard;
+    }
+
+    vec3 albedo = pow(albedo2.rgb, vec3(2.2));
+    float ao;
+    float metallic;
+    float roughness;
+
+    // missing maps make a rough dielectric
+    if (material.packing == 0) {
+        ao = sampleMap(AO_MAP, vec4(1.0)).r;
+        metallic = sampleMap(METALLIC_MAP, vec4(0.0)).r;
+        roughness = sampleMap(ROUGHNESS_MAP, vec4(1.0)).r;
+    } else {
+        vec4 packedMap = sampleMap(METALLIC_MAP, vec4(1.0, 1.0, 0.0, 1.0));
+        ao = material.packing == 1 ? sampleMap(AO_MAP, vec4(1.0)).r : packedMap.r;
+        metallic = packedMap.b;
+        roughness = packedMap.g;
+    }
+
+    if (!hasMap(AO_MAP)) {
+        ao = 1.0;
+    }
+
+    // Refractive
+    if (isRefractive) {
+        float ratio = 1.0 / 1.52;
+        vec3 I = normalize(WorldPos - camPos);
+        vec3 R = refract(I, normalize(Normal), ratio);
+        R.y = -R.y;
+        FragColor = vec4(texture(prefilterMap, R).rgb, 1.0);
+        return;
+    }
+
+    // input lighting data
+    vec3 N = getNormalFromMap();
+    vec3 V = normalize(camPos - WorldPos);
+    vec3 R = reflect(-V, N);
+
+    // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0
+    // of 0.04 and if it's a metal, use the albedo color as F0 (metallic workflow)
+    vec3 F0 = vec3(0.04);
+    F0 = mix(F0, albedo, metallic);
+
+    // ambient lighting (we now use IBL as the ambient term)
+    vec3 F = fresnelSchlickRoughness(max(dot(N, V), 0.0), F0, roughness);
+
+    vec3 kS = F;
+    vec3 kD = 1.0 - kS;
+    kD *= 1.0 - metallic;
+
+    vec3 irradiance = evaluateIrradiance(N);
+    vec3 diffuse = irradiance * albedo;
+
+    // sample both the pre-filter map and the BRDF lut and combine them together as per the Split-Sum approximation to get the IBL specular part.
+    const float MAX_REFLECTION_LOD = 4.0;
+    vec3 prefilteredColor = textureLod(prefilterMap, R, roughness * MAX_REFLECTION_LOD).rgb;
+    vec2 brdf = texture(brdfLUT, vec2(max(dot(N, V), 0.0), roughness)).rg;
+    vec3 specular = prefilteredColor * (F * brdf.x + brdf.y);
+
+    vec3 ambient = (kD * diffuse + specular) * ao;
+
+    if (hasMap(EMISSION_MAP)) {
+        ambient += sampleMap(EMISSION_MAP, vec4(0.0)).rgb;
+    } else {
+        ambient += emission;
+    }
+
+    ambient *= ambientIntensity;
+
+    // reflectance equation
+    vec3 Lo = vec3(0.0);
+
+    for (int i = 0; i < directionalLightCount; ++i) {
+        DirectionalLight light = directionalLights[i];
+        vec3 L = normalize(light.direction);
+        vec3 radiance = light.color * light.intensity;
+
+        float shadow = 0.0;
+        if (light.shadowIndex >= 0) {
+            shadow = DirectionalShadowCalculation(light.shadowIndex, light.direction);
+        }
+
+        Lo += evaluateLight(N, V, L, radiance, albedo, metallic, roughness, F0) * (1.0 - shadow);
+    }
+
+    uvec2 cluster = clusters[getClusterIndex()];
+    for (uint i = 0; i < cluster.y; ++i) {
+        Light light = lights[lightIndices[cluster.x + i]];
+
+        vec3 L = normalize(light.position - WorldPos);
+        float distance = length(light.position - WorldPos);
+        vec3 radiance = light.color * light.intensity * rangeAttenuation(distance, light.range);
+
+        float shadow = 0.0;
+        if (light.type == LIGHT_TYPE_SPOT) {
+            float theta = dot(L, normalize(-light.direction));
+            float epsilon = (light.innerAngle - light.outerAngle);
+            radiance *= clamp((theta - light.outerAngle) / epsilon, 0.0, 1.0);
+
+            if (light.shadowIndex >= 0) {
+                float bias = max(0.0001 * (1.0 - dot(Normal, light.direction)), 0.00005);
+                shadow = SpotShadowCalculation(light.shadowIndex, bias);
+            }
+        } else if (light.shadowIndex >= 0) {
+            shadow = PointShadowCalculation(light.position, light.range, light.shadowIndex);
+        }
+
+        Lo += evaluateLight(N, V, L, radiance, albedo, metallic, roughness, F0) * (1.0 - shadow);
+    }
+
+    vec3 color = ambient + Lo;
+
+    if (showClusterHeatmap) {
+        // blue for a single light, red once a cluster holds 16 or more
+        float heat = clamp(float(cluster.y) / 16.0, 0.0, 1.0);
+        color = mix(color, cluster.y == 0 ? vec3(0.0) : mix(vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), heat), 0.5);
+    }
+
+    FragColor = vec4(color, 1.0);
+}
@@ -1,29 +1,44 @@
-#version 330 core
+#version 430 core
 layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
+// octahedral encoded
+layout(location = 1) in vec2 aNormal;
 layout(location = 2) in vec2 aTexCoords;
-
-#define MAX_SHADOWS 10
+// quantized positions are stored within the mesh bounds, one entry per draw, see GeometryPool
+layout(location = 3) in vec3 aPositionScale;
+layout(location = 4) in vec3 aPositionOffset;
+// entry of the material buffer, see MaterialSystem
+layout(location = 5) in uint aMaterialIndex;
 
 out vec2 TexCoords;
 out vec3 WorldPos;
 out vec3 Normal;
-out vec4 WorldPosLightSpaces[MAX_SHADOWS];
+flat out uint MaterialIndex;
+
+layout(std140, binding = 0) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 camPos;
+};
 
-uniform mat4 projection;
-uniform mat4 view;
 uniform mat4 model;
 
-uniform mat4 lightSpaceMatrices[MAX_SHADOWS];
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    // the lower hemisphere is folded over the diagonals
+    float fold = max(-normal.z, 0.0);
+    normal.xy += vec2(normal.x >= 0.0 ? -fold : fold, normal.y >= 0.0 ? -fold : fold);
+    return normalize(normal);
+}
 
 void main()
 {
+    vec3 position = aPos * aPositionScale + aPositionOffset;
     TexCoords = aTexCoords;
-    WorldPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(model) * aNormal;
-    for (int i = 0; i < MAX_SHADOWS; ++i) {
-        WorldPosLightSpaces[i] = lightSpaceMatrices[i] * vec4(WorldPos, 1.0);
-    }
+    WorldPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(model) * decodeOctahedral(aNormal);
+    MaterialIndex = aMaterialIndex;
 
     gl_Position = projection * view * vec4(WorldPos, 1.0);
 }
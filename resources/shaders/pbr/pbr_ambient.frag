@@ -1,180 +0,0 @@
-#version 330 core
-out vec4 FragColor;
-in vec2 TexCoords;
-in vec3 WorldPos;
-in vec3 Normal;
-
-// material parameters
-uniform sampler2D albedo_map;
-uniform sampler2D normal_map;
-uniform sampler2D metallic_map;
-uniform sampler2D roughness_map;
-uniform sampler2D ao_map;
-uniform sampler2D emission_map;
-
-uniform int texture_packing_combination;
-
-uniform bool has_emission_map;
-uniform bool has_ao_map;
-
-uniform vec3 emission = vec3(0.0);
-
-// IBL
-uniform samplerCube irradianceMap;
-uniform samplerCube prefilterMap;
-uniform sampler2D brdfLUT;
-
-uniform vec3 camPos;
-
-uniform bool isRefractive;
-
-uniform float ambientIntensity;
-
-const float PI = 3.14159265359;
-// ----------------------------------------------------------------------------
-// Easy trick to get tangent-normals to world-space to keep PBR code simplified.
-// Don't worry if you don't get what's going on; you generally want to do normal
-// mapping the usual way for performance anways; I do plan make a note of this
-// technique somewhere later in the normal mapping tutorial.
-vec3 getNormalFromMap()
-{
-    vec3 tangentNormal = texture(normal_map, TexCoords).xyz * 2.0 - 1.0;
-
-    vec3 Q1 = dFdx(WorldPos);
-    vec3 Q2 = dFdy(WorldPos);
-    vec2 st1 = dFdx(TexCoords);
-    vec2 st2 = dFdy(TexCoords);
-
-    vec3 N = normalize(Normal);
-    vec3 T = normalize(Q1 * st2.t - Q2 * st1.t);
-    vec3 B = -normalize(cross(N, T));
-    mat3 TBN = mat3(T, B, N);
-
-    return normalize(TBN * tangentNormal);
-}
-// ----------------------------------------------------------------------------
-float DistributionGGX(vec3 N, vec3 H, float roughness)
-{
-    float a = roughness * roughness;
-    float a2 = a * a;
-    float NdotH = max(dot(N, H), 0.0);
-    float NdotH2 = NdotH * NdotH;
-
-    float nom = a2;
-    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
-    denom = PI * denom * denom;
-
-    return nom / denom;
-}
-// ----------------------------------------------------------------------------
-float GeometrySchlickGGX(float NdotV, float roughness)
-{
-    float r = (roughness + 1.0);
-    float k = (r * r) / 8.0;
-
-    float nom = NdotV;
-    float denom = NdotV * (1.0 - k) + k;
-
-    return nom / denom;
-}
-// ----------------------------------------------------------------------------
-float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
-{
-    float NdotV = max(dot(N, V), 0.0);
-    float NdotL = max(dot(N, L), 0.0);
-    float ggx2 = GeometrySchlickGGX(NdotV, roughness);
-    float ggx1 = GeometrySchlickGGX(NdotL, roughness);
-
-    return ggx1 * ggx2;
-}
-// ----------------------------------------------------------------------------
-vec3 fresnelSchlick(float cosTheta, vec3 F0)
-{
-    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
-}
-// ----------------------------------------------------------------------------
-vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
-{
-    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
-}
-// ----------------------------------------------------------------------------
-void main()
-{
-    // material properties
-    vec4 albedo2 = texture(albedo_map, TexCoords).rgba;
-
-    if (albedo2.a < 0.01) {
-        discard;
-    }
-
-    vec3 albedo = pow(albedo2.rgb, vec3(2.2));
-    float ao;
-    float metallic;
-    float roughness;
-
-    if (texture_packing_combination == 0) {
-        ao = texture(ao_map, TexCoords).r;
-        metallic = texture(metallic_map, TexCoords).r;
-        roughness = texture(roughness_map, TexCoords).r;
-    } else if (texture_packing_combination == 1) {
-        ao = texture(ao_map, TexCoords).r;
-        metallic = texture(metallic_map, TexCoords).b;
-        roughness = texture(metallic_map, TexCoords).g;
-    } else if (texture_packing_combination == 2) {
-        ao = texture(metallic_map, TexCoords).r;
-        metallic = texture(metallic_map, TexCoords).b;
-        roughness = texture(metallic_map, TexCoords).g;
-    }
-
-    if (!has_ao_map) {
-        ao = 1.0;
-   }
-
-   // Refractive
-    if (isRefractive) {
-        float ratio = 1.0 / 1.52;
-        vec3 I = normalize(WorldPos - camPos);
-        vec3 R = refract(I, normalize(Normal), ratio);
-        R.y = -R.y;
-        FragColor = vec4(texture(prefilterMap, R).rgb, 1.0);
-        return;
-    }
-
-    // input lighting data
-    vec3 N = getNormalFromMap();
-    vec3 V = normalize(camPos - WorldPos);
-    vec3 R = reflect(-V, N);
-
-    // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0
-    // of 0.04 and if it's a metal, use the albedo color as F0 (metallic workflow)
-    vec3 F0 = vec3(0.04);
-    F0 = mix(F0, albedo, metallic);
-
-    // ambient lighting (we now use IBL as the ambient term)
-    vec3 F = fresnelSchlickRoughness(max(dot(N, V), 0.0), F0, roughness);
-
-    vec3 kS = F;
-    vec3 kD = 1.0 - kS;
-    kD *= 1.0 - metallic;
-
-    vec3 irradiance = texture(irradianceMap, N).rgb;
-    vec3 diffuse = irradiance * albedo;
-
-    // sample both the pre-filter map and the BRDF lut and combine them together as per the Split-Sum approximation to get the IBL specular part.
-    const float MAX_REFLECTION_LOD = 4.0;
-    vec3 prefilteredColor = textureLod(prefilterMap, R, roughness * MAX_REFLECTION_LOD).rgb;
-    vec2 brdf = texture(brdfLUT, vec2(max(dot(N, V), 0.0), roughness)).rg;
-    vec3 specular = prefilteredColor * (F * brdf.x + brdf.y);
-
-    vec3 ambient = (kD * diffuse + specular) * ao;
-
-    if (has_emission_map) {
-        ambient += texture(emission_map, TexCoords).rgb;
-    } else {
-        ambient += emission;
-    }
-
-    ambient *= ambientIntensity;
-
-    FragColor = vec4(ambient, 1.0);
-}
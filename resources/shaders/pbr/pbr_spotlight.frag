@@ -1,239 +0,0 @@
-#version 330 core
-out vec4 FragColor;
-in vec2 TexCoords;
-in vec3 WorldPos;
-in vec3 Normal;
-in vec4 WorldPosLightSpaces[10];
-
-// material parameters
-uniform sampler2D albedo_map;
-uniform sampler2D normal_map;
-uniform sampler2D metallic_map;
-uniform sampler2D roughness_map;
-uniform sampler2D ao_map;
-uniform sampler2D emission_map;
-
-uniform int texture_packing_combination;
-
-uniform bool has_emission_map;
-uniform bool has_ao_map;
-
-uniform vec3 emission = vec3(0.0);
-
-// lights
-// In case uniform limit is exceeded, decrease the maximum number of lights.
-
-struct SpotLight {
-    vec3 color;
-    float intensity;
-    vec3 position;
-    vec3 direction;
-    float innerAngle;
-    float outerAngle;
-};
-
-#define MAX_SHADOWS 10
-uniform sampler2D shadow_maps[MAX_SHADOWS];
-
-uniform SpotLight lights[160];
-uniform int lightCount;
-
-uniform vec3 camPos;
-
-const float PI = 3.14159265359;
-// ----------------------------------------------------------------------------
-// Easy trick to get tangent-normals to world-space to keep PBR code simplified.
-// Don't worry if you don't get what's going on; you generally want to do normal
-// mapping the usual way for performance anways; I do plan make a note of this
-// technique somewhere later in the normal mapping tutorial.
-vec3 getNormalFromMap()
-{
-    vec3 tangentNormal = texture(normal_map, TexCoords).xyz * 2.0 - 1.0;
-
-    vec3 Q1 = dFdx(WorldPos);
-    vec3 Q2 = dFdy(WorldPos);
-    vec2 st1 = dFdx(TexCoords);
-    vec2 st2 = dFdy(TexCoords);
-
-    vec3 N = normalize(Normal);
-    vec3 T = normalize(Q1 * st2.t - Q2 * st1.t);
-    vec3 B = -normalize(cross(N, T));
-    mat3 TBN = mat3(T, B, N);
-
-    return normalize(TBN * tangentNormal);
-}
-// ----------------------------------------------------------------------------
-float DistributionGGX(vec3 N, vec3 H, float roughness)
-{
-    float a = roughness * roughness;
-    float a2 = a * a;
-    float NdotH = max(dot(N, H), 0.0);
-    float NdotH2 = NdotH * NdotH;
-
-    float nom = a2;
-    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
-    denom = PI * denom * denom;
-
-    return nom / denom;
-}
-// ----------------------------------------------------------------------------
-float GeometrySchlickGGX(float NdotV, float roughness)
-{
-    float r = (roughness + 1.0);
-    float k = (r * r) / 8.0;
-
-    float nom = NdotV;
-    float denom = NdotV * (1.0 - k) + k;
-
-    return nom / denom;
-}
-// ----------------------------------------------------------------------------
-float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
-{
-    float NdotV = max(dot(N, V), 0.0);
-    float NdotL = max(dot(N, L), 0.0);
-    float ggx2 = GeometrySchlickGGX(NdotV, roughness);
-    float ggx1 = GeometrySchlickGGX(NdotL, roughness);
-
-    return ggx1 * ggx2;
-}
-// ----------------------------------------------------------------------------
-vec3 fresnelSchlick(float cosTheta, vec3 F0)
-{
-    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
-}
-// ----------------------------------------------------------------------------
-vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
-{
-    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
-}
-
-float getSpotAngleAttenuation(vec3 l, vec3 light_dir, float inner_angle, float outer_angle)
-{
-    // the scale and offset computations can be done CPU-side
-    float cos_outer   = cos(outer_angle);
-    float spot_scale  = 1.0 / max(cos(inner_angle) - cos_outer, 1e-5);
-    float spot_offset = -cos_outer * spot_scale;
-
-    float cd          = dot(normalize(-light_dir), l);
-    float attenuation = clamp(cd * spot_scale + spot_offset, 0.0, 1.0);
-
-    return attenuation * attenuation;
-}
-
-float ShadowCalculation(vec4 worldPosLightSpace, vec3 lightDir, sampler2D shadow_map)
-{
-    // perform perspective divide
-    vec3 projCoords = worldPosLightSpace.xyz / worldPosLightSpace.w;
-    // transform to [0,1] range
-    projCoords = projCoords * 0.5 + 0.5;
-    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadow_map, projCoords.xy).r;
-    // get depth of current fragment from light's perspective
-    float currentDepth = projCoords.z;
-    // check whether current frag pos is in shadow
-
-    float bias = max(0.0001 * (1.0 - dot(Normal, lightDir)), 0.00005);
-
-    float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadow_map, 0);
-    for(int x = -1; x <= 1; ++x)
-    {
-        for(int y = -1; y <= 1; ++y)
-        {
-            float pcfDepth = texture(shadow_map, projCoords.xy + vec2(x, y) * texelSize).r;
-            shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
-        }
-    }
-    shadow /= 9.0;
-
-    return shadow;
-}
-
-// ----------------------------------------------------------------------------
-void main()
-{
-    // material properties
-    vec3 albedo = pow(texture(albedo_map, TexCoords).rgb, vec3(2.2));
-    float ao;
-    float metallic;
-    float roughness;
-
-    if (texture_packing_combination == 0) {
-        ao = texture(ao_map, TexCoords).r;
-        metallic = texture(metallic_map, TexCoords).r;
-        roughness = texture(roughness_map, TexCoords).r;
-    } else if (texture_packing_combination == 1) {
-        ao = texture(ao_map, TexCoords).r;
-        metallic = texture(metallic_map, TexCoords).b;
-        roughness = texture(metallic_map, TexCoords).g;
-    } else if (texture_packing_combination == 2) {
-        ao = texture(metallic_map, TexCoords).r;
-        metallic = texture(metallic_map, TexCoords).b;
-        roughness = texture(metallic_map, TexCoords).g;
-    }
-
-    // input lighting data
-    vec3 N = getNormalFromMap();
-    vec3 V = normalize(camPos - WorldPos);
-    vec3 R = reflect(-V, N);
-
-    // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0
-    // of 0.04 and if it's a metal, use the albedo color as F0 (metallic workflow)
-    vec3 F0 = vec3(0.04);
-    F0 = mix(F0, albedo, metallic);
-
-    // reflectance equation
-    vec3 Lo = vec3(0.0);
-    for (int i = 0; i < lightCount; ++i) {
-        SpotLight light = lights[i];
-        // calculate per-light radiance
-        vec3 L = normalize(light.position - WorldPos);
-        vec3 H = normalize(V + L);
-
-        float theta = dot(L, normalize(-light.direction));
-        float epsilon = (light.innerAngle - light.outerAngle);
-        float intensity = clamp((theta - light.outerAngle) / epsilon, 0.0, 1.0);
-
-
-        // float attenuation = getSpotAngleAttenuation(-L, -light.direction, light.innerAngle, light.outerAngle);
-        // float distance = length(light.position - WorldPos);
-        // float attenuation2 = 1.0 / (distance * distance);
-
-        vec3 radiance = light.color * light.intensity * intensity;
-
-        // Cook-Torrance BRDF
-        float NDF = DistributionGGX(N, H, roughness);
-        float G = GeometrySmith(N, V, L, roughness);
-        vec3 F = fresnelSchlick(max(dot(H, V), 0.0), F0);
-
-        vec3 numerator = NDF * G * F;
-        float denominator = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + 0.0001; // + 0.0001 to prevent divide by zero
-        vec3 specular = numerator / denominator;
-
-        // kS is equal to Fresnel
-        vec3 kS = F;
-        // for energy conservation, the diffuse and specular light can't
-        // be above 1.0 (unless the surface emits light); to preserve this
-        // relationship the diffuse component (kD) should equal 1.0 - kS.
-        vec3 kD = vec3(1.0) - kS;
-        // multiply kD by the inverse metalness such that only non-metals
-        // have diffuse lighting, or a linear blend if partly metal (pure metals
-        // have no diffuse light).
-        kD *= 1.0 - metallic;
-
-        // scale light by NdotL
-        float NdotL = max(dot(N, L), 0.0);
-
-        float shadow = 0.0;
-        if (i < MAX_SHADOWS) {
-            shadow = ShadowCalculation(WorldPosLightSpaces[i], light.direction, shadow_maps[i]);
-        }
-
-        Lo += (kD * albedo / PI + specular) * radiance * NdotL * (1.0 - shadow); // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
-    }
-
-    vec3 color = Lo;
-
-    FragColor = vec4(color, 1.0);
-}
@@ -0,0 +1,17 @@
+#version 330 core
+layout(location = 0) in vec3 aPos;
+// quantized positions are stored within the mesh bounds, one entry per draw, see GeometryPool
+layout(location = 3) in vec3 aPositionScale;
+layout(location = 4) in vec3 aPositionOffset;
+
+uniform mat4 model;
+uniform mat4 lightSpaceMatrix;
+
+out vec4 FragPos;
+
+void main()
+{
+    vec3 position = aPos * aPositionScale + aPositionOffset;
+    FragPos = model * vec4(position, 1.0);
+    gl_Position = lightSpaceMatrix * FragPos;
+}
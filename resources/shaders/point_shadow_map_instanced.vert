@@ -0,0 +1,34 @@
+#version 430 core
+// either extension lets the vertex shader pick the viewport, only compiled if one of them is supported
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_viewport_index : enable
+
+layout(location = 0) in vec3 aPos;
+// quantized positions are stored within the mesh bounds, one entry per draw, see GeometryPool
+layout(location = 3) in vec3 aPositionScale;
+layout(location = 4) in vec3 aPositionOffset;
+
+struct ShadowTile {
+    mat4 lightSpaceMatrix;
+    vec4 rect;
+};
+
+layout(std430, binding = 4) readonly buffer ShadowTileBuffer
+{
+    ShadowTile shadowTiles[];
+};
+
+uniform mat4 model;
+// first of the light's six tiles in the shadow atlas
+uniform int tileOffset;
+
+out vec4 FragPos;
+
+void main()
+{
+    vec3 position = aPos * aPositionScale + aPositionOffset;
+    // one instance per cube face, every face has its own viewport covering its atlas tile
+    FragPos = model * vec4(position, 1.0);
+    gl_ViewportIndex = gl_InstanceID;
+    gl_Position = shadowTiles[tileOffset + gl_InstanceID].lightSpaceMatrix * FragPos;
+}
@@ -4,6 +4,11 @@ in vec3 WorldPos;
 
 uniform samplerCube environmentMap;
 uniform float roughness;
+// face size of the environment map, its mips are sampled by the solid angle of every sample
+uniform float resolution;
+// face size of the level being filtered
+uniform float outputSize;
+uniform int sampleCount;
 
 const float PI = 3.14159265359;
 // ----------------------------------------------------------------------------
@@ -61,22 +66,29 @@ vec3 ImportanceSampleGGX(vec2 Xi, vec3 N, float roughness)
 	return normalize(sampleVec);
 }
 // ----------------------------------------------------------------------------
-void main()
+// ----------------------------------------------------------------------------
+// Filtered importance sampling: every sample reads the environment mip whose texels cover about the solid angle
+// the sample stands for, so a few dozen samples give what a thousand point samples of the base level would.
+vec3 prefilter(vec3 N, float roughness)
 {
-    vec3 N = normalize(WorldPos);
-
     // make the simplyfying assumption that V equals R equals the normal
     vec3 R = N;
     vec3 V = R;
 
-    const uint SAMPLE_COUNT = 1024u;
+    // never sample finer than the output texels, a mirror level is a plain downsample
+    float saTexel  = 4.0 * PI / (6.0 * resolution * resolution);
+    float minMipLevel = max(log2(resolution / outputSize), 0.0);
+    if (roughness == 0.0)
+        return textureLod(environmentMap, N, minMipLevel).rgb;
+
     vec3 prefilteredColor = vec3(0.0);
     float totalWeight = 0.0;
 
-    for(uint i = 0u; i < SAMPLE_COUNT; ++i)
+    uint count = uint(sampleCount);
+    for(uint i = 0u; i < count; ++i)
     {
         // generates a sample vector that's biased towards the preferred alignment direction (importance sampling).
-        vec2 Xi = Hammersley(i, SAMPLE_COUNT);
+        vec2 Xi = Hammersley(i, count);
         vec3 H = ImportanceSampleGGX(Xi, N, roughness);
         vec3 L  = normalize(2.0 * dot(V, H) * H - V);
 
@@ -89,18 +101,21 @@ void main()
             float HdotV = max(dot(H, V), 0.0);
             float pdf = D * NdotH / (4.0 * HdotV) + 0.0001;
 
-            float resolution = 512.0; // resolution of source cubemap (per face)
-            float saTexel  = 4.0 * PI / (6.0 * resolution * resolution);
-            float saSample = 1.0 / (float(SAMPLE_COUNT) * pdf + 0.0001);
+            float saSample = 1.0 / (float(count) * pdf + 0.0001);
 
-            float mipLevel = roughness == 0.0 ? 0.0 : 0.5 * log2(saSample / saTexel);
+            // one level of bias smooths the remaining noise
+            float mipLevel = max(0.5 * log2(saSample / saTexel) + 1.0, minMipLevel);
 
             prefilteredColor += textureLod(environmentMap, L, mipLevel).rgb * NdotL;
             totalWeight      += NdotL;
         }
     }
 
-    prefilteredColor = prefilteredColor / totalWeight;
-
-    FragColor = vec4(prefilteredColor, 1.0);
+    return prefilteredColor / totalWeight;
+}
+// ----------------------------------------------------------------------------
+void main()
+{
+    vec3 N = normalize(WorldPos);
+    FragColor = vec4(prefilter(N, roughness), 1.0);
 }
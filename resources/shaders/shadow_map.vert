@@ -1,10 +1,14 @@
 #version 330 core
 layout(location = 0) in vec3 aPos;
+// quantized positions are stored within the mesh bounds, one entry per draw, see GeometryPool
+layout(location = 3) in vec3 aPositionScale;
+layout(location = 4) in vec3 aPositionOffset;
 
 uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    vec3 position = aPos * aPositionScale + aPositionOffset;
+    gl_Position = lightSpaceMatrix * model * vec4(position, 1.0);
 }
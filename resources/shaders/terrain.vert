@@ -1,6 +1,9 @@
 #version 330 core
 layout(location = 0) in vec3 aPos;
 layout(location = 2) in vec2 aTexCoords;
+// quantized positions are stored within the mesh bounds, one entry per draw, see GeometryPool
+layout(location = 3) in vec3 aPositionScale;
+layout(location = 4) in vec3 aPositionOffset;
 
 out VS_OUT
 {
@@ -8,16 +11,15 @@ out VS_OUT
 }
 vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
 uniform mat4 model;
 
 uniform sampler2D heightMap;
 
 void main()
 {
+    vec3 position = aPos * aPositionScale + aPositionOffset;
     float height = texture(heightMap, aTexCoords).r;
-    gl_Position = vec4(aPos.x, height * 0.2f, aPos.z, 1.0f);
+    gl_Position = vec4(position.x, height * 0.2f, position.z, 1.0f);
     vs_out.texCoords = aTexCoords;
     // out_normal = mat3(transpose(inverse(model))) * normal;
 }
@@ -0,0 +1,123 @@
+#include "asset_loader.h"
+
+#include <chrono>
+
+#include <GLFW/glfw3.h>
+#include <spdlog/spdlog.h>
+
+#include "texture_uploader.h"
+
+AssetLoader::AssetLoader(unsigned int workerCount)
+{
+    if (workerCount == 0) {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+    for (unsigned int i = 0; i < workerCount; i++)
+        workers.emplace_back(&AssetLoader::workerLoop, this);
+}
+
+AssetLoader::~AssetLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobCondition.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void AssetLoader::loadModel(std::unique_ptr<Model> model, const std::string& path, Entity* parent)
+{
+    auto pending = std::make_shared<PendingModel>();
+    pending->model = std::move(model);
+    pending->path = path;
+    pending->parent = parent;
+    pending->startTime = glfwGetTime();
+    pendingCount++;
+
+    enqueue([this, pending] {
+        Model* model = pending->model.get();
+        model->parse(pending->path);
+
+        size_t textureCount = model->textures_loaded.size();
+        if (textureCount == 0) {
+            queueUpload(pending);
+            return;
+        }
+
+        // a model like Sponza has dozens of textures, decode them side by side
+        pending->texturesLeft = textureCount;
+        for (size_t i = 0; i < textureCount; i++) {
+            enqueue([this, pending, i] {
+                pending->model->decodeTexture(i);
+                if (--pending->texturesLeft == 0)
+                    queueUpload(pending);
+            });
+        }
+    });
+}
+
+void AssetLoader::processUploads(double budgetMs)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    auto start = Clock::now();
+
+    do {
+        if (!currentUpload) {
+            std::lock_guard<std::mutex> lock(uploadMutex);
+            if (uploads.empty())
+                return;
+            currentUpload = uploads.front();
+            uploads.pop_front();
+        }
+
+        if (currentUpload->model->uploadStep()) {
+            Entity* parent = currentUpload->parent;
+            parent->addChild(std::move(currentUpload->model));
+            // the scene graph only updates at the end of the frame, the model is drawn before that
+            parent->children.back()->forceUpdateSelfAndChildren();
+
+            spdlog::info("Loaded {} in {:.2f} s", parent->children.back()->name, glfwGetTime() - currentUpload->startTime);
+            currentUpload.reset();
+            pendingCount--;
+            loadedCount++;
+        }
+        // the upload ring is full until the GPU catches up, try again next frame
+        if (TextureUploader::get().hasStalled())
+            return;
+    } while (std::chrono::duration<double, std::milli>(Clock::now() - start).count() < budgetMs);
+}
+
+void AssetLoader::enqueue(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobs.push_back(std::move(job));
+    }
+    jobCondition.notify_one();
+}
+
+void AssetLoader::queueUpload(std::shared_ptr<PendingModel> pending)
+{
+    std::lock_guard<std::mutex> lock(uploadMutex);
+    uploads.push_back(std::move(pending));
+}
+
+void AssetLoader::workerLoop()
+{
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+            // jobs still queued on shutdown are dropped, their models are freed with them
+            if (stopping)
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "entity.h"
+#include "model.h"
+
+// Loads models in the background. Worker threads parse the file and decode every texture (one job per texture),
+// the GL uploads run on the render thread in processUploads() a few at a time, so a frame never stalls on a whole
+// model. A model is added to its parent once all of its textures and meshes are on the GPU.
+class AssetLoader {
+public:
+    // workerCount 0 uses every hardware thread but the one rendering
+    explicit AssetLoader(unsigned int workerCount = 0);
+    ~AssetLoader();
+
+    // set up the model's transform before handing it over, it is attached to parent when ready
+    void loadModel(std::unique_ptr<Model> model, const std::string& path, Entity* parent);
+
+    // runs upload steps of decoded models until budgetMs is used up, at least one step per call
+    void processUploads(double budgetMs);
+
+    // models submitted but not attached yet
+    unsigned int getPendingCount() const { return pendingCount; }
+    unsigned int getLoadedCount() const { return loadedCount; }
+
+private:
+    struct PendingModel {
+        std::unique_ptr<Model> model;
+        std::string path;
+        Entity* parent;
+        double startTime;
+        std::atomic<size_t> texturesLeft { 0 };
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex jobMutex;
+    std::condition_variable jobCondition;
+    bool stopping = false;
+
+    // decoded models waiting for the render thread
+    std::deque<std::shared_ptr<PendingModel>> uploads;
+    std::mutex uploadMutex;
+    // the model being uploaded, only touched by the render thread
+    std::shared_ptr<PendingModel> currentUpload;
+
+    std::atomic<unsigned int> pendingCount { 0 };
+    std::atomic<unsigned int> loadedCount { 0 };
+
+    void enqueue(std::function<void()> job);
+    void queueUpload(std::shared_ptr<PendingModel> pending);
+    void workerLoop();
+};
+
+#endif
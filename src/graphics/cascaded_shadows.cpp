@@ -0,0 +1,88 @@
+#include "cascaded_shadows.h"
+
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+void CascadedShadows::update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    int count = getCascadeCount();
+    float distance = glm::min(shadowDistance, farPlane);
+
+    // practical split scheme: logarithmic splits keep the texel density even, uniform ones avoid tiny near cascades
+    for (int i = 0; i < count; i++) {
+        float ratio = static_cast<float>(i + 1) / count;
+        float logSplit = nearPlane * std::pow(distance / nearPlane, ratio);
+        float uniformSplit = nearPlane + (distance - nearPlane) * ratio;
+        splits[i] = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+    }
+
+    // world space frustum corners at the near and far plane
+    glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+    glm::vec3 nearCorners[4];
+    glm::vec3 farCorners[4];
+    for (int i = 0; i < 4; i++) {
+        glm::vec2 ndc = glm::vec2((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f);
+        glm::vec4 nearCorner = inverseViewProjection * glm::vec4(ndc, -1.0f, 1.0f);
+        glm::vec4 farCorner = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+        nearCorners[i] = glm::vec3(nearCorner) / nearCorner.w;
+        farCorners[i] = glm::vec3(farCorner) / farCorner.w;
+    }
+
+    for (int i = 0; i < count; i++) {
+        float sliceNear = i == 0 ? nearPlane : splits[i - 1];
+        float sliceFar = splits[i];
+
+        // positions along a corner ray are linear in view depth
+        glm::vec3 corners[8];
+        for (int j = 0; j < 4; j++) {
+            glm::vec3 ray = farCorners[j] - nearCorners[j];
+            corners[j] = nearCorners[j] + ray * ((sliceNear - nearPlane) / (farPlane - nearPlane));
+            corners[j + 4] = nearCorners[j] + ray * ((sliceFar - nearPlane) / (farPlane - nearPlane));
+        }
+
+        glm::vec3 center = glm::vec3(0.0f);
+        for (int j = 0; j < 8; j++) {
+            center += corners[j];
+        }
+        center /= 8.0f;
+
+        float radius = 0.0f;
+        for (int j = 0; j < 8; j++) {
+            radius = glm::max(radius, glm::length(corners[j] - center));
+        }
+
+        // a sphere doesn't change size when the camera rotates, round it so float noise doesn't either
+        sliceCenters[i] = center;
+        sliceRadii[i] = std::ceil(radius * 16.0f) / 16.0f;
+    }
+}
+
+void CascadedShadows::computeLightMatrices(const glm::vec3& lightDir, const AABB& sceneBounds, unsigned int resolution, glm::mat4* matrices) const
+{
+    glm::vec3 direction = glm::normalize(lightDir);
+    glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+    // the light view only depends on the direction, so moving the camera just slides the cascades in light space
+    glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+    AABB sceneBoundsLightSpace = sceneBounds.transformed(lightView);
+
+    for (int i = 0; i < getCascadeCount(); i++) {
+        float radius = sliceRadii[i];
+        glm::vec3 center = glm::vec3(lightView * glm::vec4(sliceCenters[i], 1.0f));
+
+        float texelSize = 2.0f * radius / resolution;
+        center.x = std::floor(center.x / texelSize) * texelSize;
+        center.y = std::floor(center.y / texelSize) * texelSize;
+
+        // the light looks down -z, casters between the light and the slice have a larger z
+        float maxZ = center.z + radius;
+        float minZ = center.z - radius;
+        if (sceneBoundsLightSpace.isValid()) {
+            maxZ = glm::max(maxZ, sceneBoundsLightSpace.max.z);
+        }
+
+        glm::mat4 lightProjection = glm::ortho(center.x - radius, center.x + radius, center.y - radius, center.y + radius, -maxZ, -minZ);
+        matrices[i] = lightProjection * lightView;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef CASCADED_SHADOWS_H
+#define CASCADED_SHADOWS_H
+
+#include <glm/glm.hpp>
+
+#include "culling.h"
+
+// must match MAX_CASCADES in pbr.frag and shadow_map_cascades.geom
+#define MAX_SHADOW_CASCADES 4
+
+// Splits the camera frustum into depth slices and fits one orthographic shadow map around each slice, so
+// directional shadows spend their resolution close to the camera instead of on a fixed box around the light.
+class CascadedShadows {
+public:
+    int cascadeCount = 4;
+    // blends between uniform (0) and logarithmic (1) split distances
+    float splitLambda = 0.75f;
+    // shadows end here, or at the camera's far plane if that is closer
+    float shadowDistance = 60.0f;
+
+    // recomputes the split depths and the bounding sphere of every camera frustum slice
+    void update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+
+    // Writes one light space matrix per cascade. The cascades are snapped to whole shadow map texels so they don't
+    // shimmer when the camera moves, and their near planes are pulled back to the scene bounds so casters in front
+    // of a slice still cast into it.
+    void computeLightMatrices(const glm::vec3& lightDir, const AABB& sceneBounds, unsigned int resolution, glm::mat4* matrices) const;
+
+    int getCascadeCount() const { return glm::clamp(cascadeCount, 1, MAX_SHADOW_CASCADES); }
+    // view space depth the cascade ends at
+    float getSplit(int cascade) const { return splits[cascade]; }
+
+private:
+    float splits[MAX_SHADOW_CASCADES] = {};
+    glm::vec3 sliceCenters[MAX_SHADOW_CASCADES];
+    float sliceRadii[MAX_SHADOW_CASCADES] = {};
+};
+
+#endif
@@ -1,6 +1,8 @@
 #include "common.h"
 
 #include <cstdio>
+#include <cstring>
+#include <vector>
 #include <string>
 
 #include <spdlog/spdlog.h>
@@ -37,3 +39,17 @@ GLenum glCheckError_(const char* file, int line)
     }
     return errorCode;
 }
+
+void flipImageVertically(void* pixels, int width, int height, size_t bytesPerPixel)
+{
+    size_t rowSize = width * bytesPerPixel;
+    std::vector<unsigned char> row(rowSize);
+    unsigned char* bytes = static_cast<unsigned char*>(pixels);
+    for (int y = 0; y < height / 2; y++) {
+        unsigned char* top = bytes + y * rowSize;
+        unsigned char* bottom = bytes + (height - 1 - y) * rowSize;
+        std::memcpy(row.data(), top, rowSize);
+        std::memcpy(top, bottom, rowSize);
+        std::memcpy(bottom, row.data(), rowSize);
+    }
+}
@@ -1,10 +1,16 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <cstddef>
+
 #include <glad/glad.h>
 
 GLenum glCheckError_(const char* file, int line);
 
 #define glCheckError() glCheckError_(__FILE__, __LINE__)
 
+// Flips decoded image rows in place. stb_image's flip setting is one flag for the whole process in the bundled
+// version, so it stays off while the asset loader decodes on worker threads and loads that want it flip here.
+void flipImageVertically(void* pixels, int width, int height, size_t bytesPerPixel);
+
 #endif
@@ -0,0 +1,76 @@
+#include "compressed_texture.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include "dds.h"
+
+bool CompressedImage::load(const std::string& path)
+{
+    clear();
+
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream)
+        return false;
+
+    uint32_t magic = 0;
+    DDSHeader header = {};
+    DDSHeaderDX10 headerDX10 = {};
+    stream.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+    stream.read(reinterpret_cast<char*>(&headerDX10), sizeof(headerDX10));
+    if (!stream || magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || header.pixelFormat.fourCC != DDS_FOURCC_DX10)
+        return false;
+
+    switch (headerDX10.dxgiFormat) {
+    case DXGI_FORMAT_BC1_UNORM:
+        format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        break;
+    case DXGI_FORMAT_BC5_UNORM:
+        format = GL_COMPRESSED_RG_RGTC2;
+        break;
+    case DXGI_FORMAT_BC7_UNORM:
+        format = GL_COMPRESSED_RGBA_BPTC_UNORM;
+        break;
+    default:
+        return false;
+    }
+
+    data.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+
+    uint32_t blockSize = getDDSBlockSize(headerDX10.dxgiFormat);
+    unsigned int mipCount = std::max(header.mipMapCount, 1u);
+    int width = header.width;
+    int height = header.height;
+    size_t offset = 0;
+    for (unsigned int i = 0; i < mipCount; i++) {
+        size_t size = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+        if (offset + size > data.size()) {
+            clear();
+            return false;
+        }
+        levels.push_back({ offset, size, width, height });
+        offset += size;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    return true;
+}
+
+void CompressedImage::clear()
+{
+    format = 0;
+    data.clear();
+    data.shrink_to_fit();
+    levels.clear();
+}
+
+std::string getCookedTexturePath(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + ".dds";
+    return path.substr(0, dot) + ".dds";
+}
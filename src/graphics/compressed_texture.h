@@ -0,0 +1,36 @@
+#ifndef COMPRESSED_TEXTURE_H
+#define COMPRESSED_TEXTURE_H
+
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+// part of EXT_texture_compression_s3tc, not core but exposed by every desktop driver
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+// A block compressed mip chain read from a cooked DDS file, uploaded as is.
+struct CompressedImage {
+    struct Level {
+        size_t offset;
+        size_t size;
+        int width;
+        int height;
+    };
+
+    GLenum format = 0;
+    std::vector<unsigned char> data;
+    std::vector<Level> levels;
+
+    bool isValid() const { return !levels.empty(); }
+    // reads a DDS written by the texture cooker (BC1, BC5 or BC7), false for anything else
+    bool load(const std::string& path);
+    void clear();
+};
+
+// where the cooker puts the compressed version of an image, next to it with a .dds extension
+std::string getCookedTexturePath(const std::string& path);
+
+#endif
@@ -0,0 +1,168 @@
+#include "culling.h"
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CULLING_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+void AABB::expand(const glm::vec3& point)
+{
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+void AABB::expand(const AABB& other)
+{
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+}
+
+AABB AABB::transformed(const glm::mat4& matrix) const
+{
+    if (!isValid()) {
+        return *this;
+    }
+
+    // Arvo's method: transform the center and project the extents onto the absolute matrix axes
+    glm::vec3 center = glm::vec3(matrix * glm::vec4(getCenter(), 1.0f));
+    glm::vec3 extents = getExtents();
+    glm::vec3 newExtents = glm::abs(glm::vec3(matrix[0])) * extents.x
+        + glm::abs(glm::vec3(matrix[1])) * extents.y
+        + glm::abs(glm::vec3(matrix[2])) * extents.z;
+
+    AABB result;
+    result.min = center - newExtents;
+    result.max = center + newExtents;
+    return result;
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4& m)
+{
+    glm::vec4 row0 = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1 = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2 = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3 = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[0] = row3 + row0;
+    frustum.planes[1] = row3 - row0;
+    frustum.planes[2] = row3 + row1;
+    frustum.planes[3] = row3 - row1;
+    frustum.planes[4] = row3 + row2;
+    frustum.planes[5] = row3 - row2;
+
+    for (auto& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+
+    return frustum;
+}
+
+bool Frustum::intersects(const AABB& box) const
+{
+    glm::vec3 center = box.getCenter();
+    glm::vec3 extents = box.getExtents();
+    for (const auto& plane : planes) {
+        glm::vec3 normal = glm::vec3(plane);
+        float distance = glm::dot(normal, center) + plane.w;
+        float radius = glm::dot(glm::abs(normal), extents);
+        if (distance + radius < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AABBList::resize(size_t newCount)
+{
+    count = newCount;
+
+    // pad to a multiple of four so the SIMD loop never reads past the end
+    size_t padded = (newCount + 3) & ~size_t(3);
+    centerX.resize(padded, 0.0f);
+    centerY.resize(padded, 0.0f);
+    centerZ.resize(padded, 0.0f);
+    extentX.resize(padded, 0.0f);
+    extentY.resize(padded, 0.0f);
+    extentZ.resize(padded, 0.0f);
+}
+
+void AABBList::set(size_t index, const AABB& box)
+{
+    glm::vec3 center = box.getCenter();
+    glm::vec3 extents = box.getExtents();
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    extentX[index] = extents.x;
+    extentY[index] = extents.y;
+    extentZ[index] = extents.z;
+}
+
+size_t cullAABBs(const Frustum& frustum, const AABBList& boxes, std::vector<unsigned char>& visibility)
+{
+    visibility.resize(boxes.count);
+
+    size_t visibleCount = 0;
+    size_t i = 0;
+
+#ifdef CULLING_USE_SSE
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    __m128 absPlaneX[6], absPlaneY[6], absPlaneZ[6];
+    for (int p = 0; p < 6; p++) {
+        planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+        absPlaneX[p] = _mm_andnot_ps(signMask, planeX[p]);
+        absPlaneY[p] = _mm_andnot_ps(signMask, planeY[p]);
+        absPlaneZ[p] = _mm_andnot_ps(signMask, planeZ[p]);
+    }
+
+    for (; i < boxes.count; i += 4) {
+        __m128 cx = _mm_loadu_ps(&boxes.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&boxes.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&boxes.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+        __m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+                _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absPlaneX[p], ex), _mm_mul_ps(absPlaneY[p], ey)),
+                _mm_mul_ps(absPlaneZ[p], ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        }
+
+        int mask = _mm_movemask_ps(outside);
+        size_t remaining = boxes.count - i < 4 ? boxes.count - i : 4;
+        for (size_t lane = 0; lane < remaining; lane++) {
+            unsigned char visible = (mask & (1 << lane)) ? 0 : 1;
+            visibility[i + lane] = visible;
+            visibleCount += visible;
+        }
+    }
+#else
+    for (; i < boxes.count; i++) {
+        bool visible = true;
+        for (const auto& plane : frustum.planes) {
+            float distance = plane.x * boxes.centerX[i] + plane.y * boxes.centerY[i] + plane.z * boxes.centerZ[i] + plane.w;
+            float radius = std::abs(plane.x) * boxes.extentX[i] + std::abs(plane.y) * boxes.extentY[i] + std::abs(plane.z) * boxes.extentZ[i];
+            if (distance + radius < 0.0f) {
+                visible = false;
+                break;
+            }
+        }
+        visibility[i] = visible ? 1 : 0;
+        visibleCount += visible ? 1 : 0;
+    }
+#endif
+
+    return visibleCount;
+}
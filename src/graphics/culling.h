@@ -0,0 +1,63 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <cfloat>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool isValid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+    glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+    glm::vec3 getExtents() const { return (max - min) * 0.5f; }
+
+    void expand(const glm::vec3& point);
+    void expand(const AABB& other);
+    // returns the box enclosing this box after transforming it by the given matrix
+    AABB transformed(const glm::mat4& matrix) const;
+};
+
+struct Frustum {
+    // left, right, bottom, top, near, far; normals point inwards
+    glm::vec4 planes[6];
+
+    // extracts the planes of a (projection * view) matrix
+    static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+    bool intersects(const AABB& box) const;
+};
+
+// Boxes stored as structure of arrays (center / extents), so the frustum test can check four boxes at once.
+class AABBList {
+public:
+    void resize(size_t count);
+    void set(size_t index, const AABB& box);
+    size_t size() const { return count; }
+
+private:
+    friend size_t cullAABBs(const Frustum& frustum, const AABBList& boxes, std::vector<unsigned char>& visibility);
+
+    size_t count = 0;
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+};
+
+struct CullStats {
+    unsigned int drawn = 0;
+    unsigned int culled = 0;
+
+    void reset()
+    {
+        drawn = 0;
+        culled = 0;
+    }
+};
+
+// Writes 1 into visibility[i] for every box that intersects the frustum and 0 otherwise.
+// Returns the number of visible boxes.
+size_t cullAABBs(const Frustum& frustum, const AABBList& boxes, std::vector<unsigned char>& visibility);
+
+#endif
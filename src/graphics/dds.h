@@ -0,0 +1,75 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include <cstdint>
+
+// DDS container layout shared by the texture cooker (tools/texture_cooker) and the runtime loader. Cooked textures
+// always use the DX10 extension header, followed by the block compressed mip chain, largest level first.
+
+#define DDS_MAGIC 0x20534444 // "DDS "
+#define DDS_FOURCC_DX10 0x30315844 // "DX10"
+
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDPF_FOURCC 0x4
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+#define DDS_DIMENSION_TEXTURE2D 3
+
+enum DXGIFormat : uint32_t {
+    DXGI_FORMAT_BC1_UNORM = 71,
+    DXGI_FORMAT_BC5_UNORM = 83,
+    DXGI_FORMAT_BC7_UNORM = 98,
+};
+
+struct DDSPixelFormat {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t rBitMask;
+    uint32_t gBitMask;
+    uint32_t bBitMask;
+    uint32_t aBitMask;
+};
+
+struct DDSHeader {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    DDSPixelFormat pixelFormat;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+
+struct DDSHeaderDX10 {
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+static_assert(sizeof(DDSHeader) == 124, "DDS header layout");
+static_assert(sizeof(DDSHeaderDX10) == 20, "DDS DX10 header layout");
+
+// bytes of one 4x4 block
+inline uint32_t getDDSBlockSize(uint32_t dxgiFormat)
+{
+    return dxgiFormat == DXGI_FORMAT_BC1_UNORM ? 8 : 16;
+}
+
+#endif
@@ -11,11 +11,13 @@ glm::mat4 Transform::getLocalModelMatrix()
 void Transform::computeModelMatrix()
 {
     modelMatrix = getLocalModelMatrix();
+    version++;
 }
 
 void Transform::computeModelMatrix(const glm::mat4& parentGlobalModelMatrix)
 {
     modelMatrix = parentGlobalModelMatrix * getLocalModelMatrix();
+    version++;
 }
 
 void Entity::updateSelfAndChildren()
@@ -25,6 +27,7 @@ void Entity::updateSelfAndChildren()
             transform.computeModelMatrix(parent->transform.modelMatrix);
         else
             transform.computeModelMatrix();
+        updateBounds();
 
         for (auto&& child : children) {
             child->transform.isDirty = true;
@@ -43,6 +46,7 @@ void Entity::forceUpdateSelfAndChildren()
         transform.computeModelMatrix(parent->transform.modelMatrix);
     else
         transform.computeModelMatrix();
+    updateBounds();
 
     for (auto&& child : children) {
         child->forceUpdateSelfAndChildren();
@@ -22,6 +22,8 @@ struct Transform {
     glm::mat4 modelMatrix = glm::mat4(1.0f);
 
     bool isDirty = true;
+    // bumped whenever the model matrix is recomputed, isDirty is already cleared again by the time a frame renders
+    unsigned int version = 0;
 
     glm::mat4 getLocalModelMatrix();
     void computeModelMatrix();
@@ -53,6 +55,11 @@ public:
     virtual void Draw(Shader& shader)
     {
     }
+
+    // called whenever the model matrix has been recomputed
+    virtual void updateBounds()
+    {
+    }
 };
 
 #endif
@@ -0,0 +1,59 @@
+#ifndef FRAME_DATA_H
+#define FRAME_DATA_H
+
+#include <glm/glm.hpp>
+
+// Per-frame data shared with the shaders through uniform / storage buffers.
+// Layouts must match the blocks declared in the shaders (std140 for uniform blocks, std430 for storage blocks).
+
+// layers, every shadowed directional light takes one per cascade
+#define DIRECTIONAL_DEPTH_MAP_COUNT 10
+
+// uniform block binding points
+#define CAMERA_UNIFORM_BINDING 0
+#define SHADOW_UNIFORM_BINDING 1
+#define IRRADIANCE_UNIFORM_BINDING 2
+
+// storage block binding points, 0 - 2 are used by the light clusters
+#define DIRECTIONAL_LIGHT_BUFFER_BINDING 3
+#define SHADOW_TILE_BUFFER_BINDING 4
+
+struct CameraData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 position;
+    float padding;
+};
+
+struct ShadowData {
+    // cascade c of a directional light is layer shadowIndex + c
+    glm::mat4 directionalLightSpaceMatrices[DIRECTIONAL_DEPTH_MAP_COUNT];
+    // view space depth every cascade ends at
+    glm::vec4 cascadeSplits;
+    int cascadeCount;
+    int padding[3];
+};
+
+// One spot light or point light face in the shadow atlas. Point lights use six consecutive tiles in
+// cube map face order (+X, -X, +Y, -Y, +Z, -Z).
+struct ShadowTileData {
+    glm::mat4 lightSpaceMatrix;
+    // offset and scale in atlas texture coordinates
+    glm::vec4 rect;
+};
+
+// L2 spherical harmonics of the environment's diffuse irradiance, rgb per coefficient (std140 pads them to vec4).
+// Basis constants are folded in, evaluated as c0 + c1 y + c2 z + c3 x + c4 xy + c5 yz + c6 (3z^2 - 1) + c7 xz
+// + c8 (x^2 - y^2).
+struct IrradianceData {
+    glm::vec4 coefficients[9];
+};
+
+struct DirectionalLightData {
+    glm::vec3 direction;
+    float intensity;
+    glm::vec3 color;
+    int shadowIndex;
+};
+
+#endif
@@ -0,0 +1,164 @@
+#include "geometry_pool.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#include "mesh.h"
+
+// instanced attributes with this divisor never advance within a draw
+static constexpr GLuint DRAW_DATA_DIVISOR = 0x7fffffff;
+
+static constexpr size_t INITIAL_VERTEX_BYTES = 16 << 20;
+static constexpr size_t INITIAL_INDEX_BYTES = 16 << 20;
+static constexpr size_t INITIAL_DRAW_DATA_BYTES = 1024 * sizeof(MeshDrawData);
+
+bool GeometryPool::multiDrawEnabled = true;
+
+GeometryPool& GeometryPool::get()
+{
+    static GeometryPool pool;
+    return pool;
+}
+
+GeometryPool::GeometryPool()
+{
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &indirectBuffer);
+    grow(vertexBuffer, vertexCapacity, 0, INITIAL_VERTEX_BYTES);
+    grow(indexBuffer, indexCapacity, 0, INITIAL_INDEX_BYTES);
+    grow(drawDataBuffer, drawDataCapacity, 0, INITIAL_DRAW_DATA_BYTES);
+    setupAttributes();
+}
+
+void GeometryPool::grow(unsigned int& buffer, size_t& capacity, size_t usedBytes, size_t neededBytes)
+{
+    size_t newCapacity = std::max(capacity * 2, neededBytes);
+
+    // the copy targets leave the bindings of whatever VAO is bound alone
+    unsigned int larger;
+    glGenBuffers(1, &larger);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, larger);
+    glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, nullptr, GL_STATIC_DRAW);
+    if (buffer) {
+        if (usedBytes > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    buffer = larger;
+    capacity = newCapacity;
+}
+
+void GeometryPool::setupAttributes()
+{
+    glBindVertexArray(vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, Normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, TexCoords));
+
+    glBindBuffer(GL_ARRAY_BUFFER, drawDataBuffer);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(MeshDrawData), (void*)offsetof(MeshDrawData, positionScale));
+    glVertexAttribDivisor(3, DRAW_DATA_DIVISOR);
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(MeshDrawData), (void*)offsetof(MeshDrawData, positionOffset));
+    glVertexAttribDivisor(4, DRAW_DATA_DIVISOR);
+    glEnableVertexAttribArray(5);
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(MeshDrawData), (void*)offsetof(MeshDrawData, materialIndex));
+    glVertexAttribDivisor(5, DRAW_DATA_DIVISOR);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+GeometryPool::Allocation GeometryPool::allocate(const void* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+{
+    size_t usedVertexBytes = usedVertices * sizeof(QuantizedVertex);
+    size_t usedIndexBytes = usedIndices * sizeof(unsigned int);
+    size_t vertexBytes = vertexCount * sizeof(QuantizedVertex);
+    size_t indexBytes = indexCount * sizeof(unsigned int);
+
+    bool grown = false;
+    if (usedVertexBytes + vertexBytes > vertexCapacity) {
+        grow(vertexBuffer, vertexCapacity, usedVertexBytes, usedVertexBytes + vertexBytes);
+        grown = true;
+    }
+    if (usedIndexBytes + indexBytes > indexCapacity) {
+        grow(indexBuffer, indexCapacity, usedIndexBytes, usedIndexBytes + indexBytes);
+        grown = true;
+    }
+    if (grown)
+        setupAttributes();
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, usedVertexBytes, vertexBytes, vertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, usedIndexBytes, indexBytes, indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    Allocation allocation;
+    allocation.baseVertex = static_cast<int>(usedVertices);
+    allocation.firstIndex = static_cast<unsigned int>(usedIndices);
+    usedVertices += vertexCount;
+    usedIndices += indexCount;
+
+    stats.vertexBytes = usedVertices * sizeof(QuantizedVertex);
+    stats.indexBytes = usedIndices * sizeof(unsigned int);
+    return allocation;
+}
+
+unsigned int GeometryPool::addDrawData(const MeshDrawData& data)
+{
+    size_t usedBytes = drawData.size() * sizeof(MeshDrawData);
+    if (usedBytes + sizeof(MeshDrawData) > drawDataCapacity) {
+        grow(drawDataBuffer, drawDataCapacity, usedBytes, usedBytes + sizeof(MeshDrawData));
+        setupAttributes();
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, drawDataBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, usedBytes, sizeof(MeshDrawData), &data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    drawData.push_back(data);
+    stats.drawCount = static_cast<unsigned int>(drawData.size());
+    return static_cast<unsigned int>(drawData.size() - 1);
+}
+
+void GeometryPool::multiDraw(const std::vector<DrawElementsIndirectCommand>& commands)
+{
+    if (commands.empty())
+        return;
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    // respecified every call, the driver keeps the commands of draws still in flight
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(commands.size()), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+
+    countDraw(static_cast<unsigned int>(commands.size()));
+}
+
+void GeometryPool::countDraw(unsigned int meshes)
+{
+    stats.drawCalls++;
+    stats.drawnMeshes += meshes;
+}
+
+void GeometryPool::resetFrameStats()
+{
+    stats.drawCalls = 0;
+    stats.drawnMeshes = 0;
+}
@@ -0,0 +1,95 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Layout of the commands read by glDrawElementsIndirect and glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+// Per mesh vertex attributes (locations 3 to 5), turning quantized positions back into model space and selecting
+// the mesh's entry of the MaterialSystem.
+struct MeshDrawData {
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+    unsigned int materialIndex;
+};
+
+// Shared vertex and index buffers for all quantized meshes, suballocated front to back, with one VAO. Meshes in the
+// pool differ only in their base vertex and first index, so any number of them is drawn with one
+// glMultiDrawElementsIndirect. Their MeshDrawData sits in a third buffer read as instanced attributes whose divisor
+// is larger than any instance count, so every instance of a draw reads the entry at its base instance. Draws set the
+// base instance to the mesh's draw index and gl_InstanceID keeps counting from 0.
+// Buffers grow by copying into larger ones, the VAO stays the same. Nothing is ever freed, like the meshes.
+class GeometryPool {
+public:
+    struct Allocation {
+        int baseVertex = 0;
+        unsigned int firstIndex = 0;
+    };
+
+    struct Stats {
+        size_t vertexBytes = 0;
+        size_t indexBytes = 0;
+        unsigned int drawCount = 0;
+        // since resetFrameStats(), every glDraw* call and the meshes they drew
+        unsigned int drawCalls = 0;
+        unsigned int drawnMeshes = 0;
+    };
+
+    // the first call creates the buffers and has to come from the render thread
+    static GeometryPool& get();
+
+    // copies vertices in the QuantizedVertex layout and their indices into the pool
+    Allocation allocate(const void* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount);
+    // adds the attributes of a mesh, returns its draw index. Meshes outside of the pool get one as well, their
+    // draws set the attributes as constants.
+    unsigned int addDrawData(const MeshDrawData& data);
+    const MeshDrawData& getDrawData(unsigned int drawIndex) const { return drawData[drawIndex]; }
+
+    unsigned int getVAO() const { return vao; }
+    // uploads the commands and draws them in one call with the pool's VAO
+    void multiDraw(const std::vector<DrawElementsIndirectCommand>& commands);
+    // for draws issued elsewhere
+    void countDraw(unsigned int meshes);
+
+    Stats getStats() const { return stats; }
+    void resetFrameStats();
+
+    // draw pooled meshes of a model with one multi draw instead of one draw each
+    static bool multiDrawEnabled;
+
+private:
+    GeometryPool();
+
+    unsigned int vao = 0;
+    unsigned int vertexBuffer = 0;
+    unsigned int indexBuffer = 0;
+    unsigned int drawDataBuffer = 0;
+    unsigned int indirectBuffer = 0;
+
+    // in bytes
+    size_t vertexCapacity = 0;
+    size_t indexCapacity = 0;
+    size_t drawDataCapacity = 0;
+    size_t usedVertices = 0;
+    size_t usedIndices = 0;
+    std::vector<MeshDrawData> drawData;
+
+    Stats stats;
+
+    // replaces buffer by a larger one holding the first usedBytes of it
+    static void grow(unsigned int& buffer, size_t& capacity, size_t usedBytes, size_t neededBytes);
+    void setupAttributes();
+};
+
+#endif
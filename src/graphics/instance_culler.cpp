@@ -0,0 +1,164 @@
+#include "instance_culler.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#include <glm/gtc/packing.hpp>
+
+static constexpr UniformId FRUSTUM_PLANES("frustumPlanes");
+static constexpr UniformId INSTANCE_COUNT("instanceCount");
+static constexpr UniformId MESH_COUNT("meshCount");
+static constexpr UniformId BOUNDING_SPHERE("boundingSphere");
+static constexpr UniformId CAMERA_POSITION("cameraPosition");
+static constexpr UniformId PIXELS_PER_UNIT("pixelsPerUnit");
+static constexpr UniformId LOD_COUNT("lodCount");
+static constexpr UniformId LOD_ERRORS("lodErrors");
+static constexpr UniformId LOD_PIXEL_ERROR("lodPixelError");
+static constexpr UniformId LOD_HYSTERESIS("lodHysteresis");
+static constexpr UniformId VISIBLE_OFFSET("visibleOffset");
+
+// must match local_size_x in instance_cull.comp
+#define INSTANCE_CULL_GROUP_SIZE 256
+
+InstanceData InstanceData::pack(const glm::vec3& position, const glm::quat& rotation, float scale)
+{
+    // q and -q are the same rotation, flip it so w can be reconstructed as the positive root
+    glm::quat q = glm::normalize(rotation);
+    if (q.w < 0.0f) {
+        q = -q;
+    }
+
+    InstanceData instance;
+    instance.position = position;
+    instance.rotationXY = glm::packSnorm2x16(glm::vec2(q.x, q.y));
+    instance.rotationZScale = glm::packSnorm1x16(q.z) | (static_cast<uint32_t>(glm::packHalf1x16(scale)) << 16);
+    return instance;
+}
+
+InstanceCuller::InstanceCuller(const std::vector<InstanceData>& instances, const std::vector<Mesh>& meshes)
+    : cullShader("instance_cull.comp")
+    , meshCount(static_cast<unsigned int>(meshes.size()))
+    , instanceCount(static_cast<unsigned int>(instances.size()))
+{
+    AABB bounds;
+    for (const Mesh& mesh : meshes) {
+        bounds.expand(mesh.aabb);
+        pooled &= mesh.pooled;
+        lodCount = std::max(lodCount, static_cast<unsigned int>(std::min<size_t>(mesh.lods.size(), MAX_MESH_LODS)));
+    }
+    boundingSphere = glm::vec4(bounds.getCenter(), glm::length(bounds.getExtents()));
+
+    // meshes with fewer levels repeat their coarsest one
+    for (unsigned int lod = 0; lod < lodCount; lod++) {
+        for (const Mesh& mesh : meshes) {
+            // the compute shader counts the instances
+            drawCommands.push_back(mesh.getDrawCommand(lod, 0));
+            lodErrors[lod] = std::max(lodErrors[lod], mesh.lods[std::min<size_t>(lod, mesh.lods.size() - 1)].error);
+        }
+    }
+
+    glGenBuffers(1, &instanceBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, instances.size() * sizeof(InstanceData), instances.data(), GL_STATIC_DRAW);
+
+    // worst case every instance is visible with the same level, every level has room for all of them
+    glGenBuffers(1, &visibleInstanceBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleInstanceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, lodCount * instances.size() * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+
+    std::vector<unsigned int> instanceLods(instances.size(), 0);
+    glGenBuffers(1, &instanceLodBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceLodBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, instanceLods.size() * sizeof(unsigned int), instanceLods.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenBuffers(1, &drawCommandBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCommands.size() * sizeof(DrawElementsIndirectCommand), drawCommands.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glGenBuffers(2, readbackBuffers);
+    for (unsigned int buffer : readbackBuffers) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, lodCount * sizeof(unsigned int), NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void InstanceCuller::cull(const Frustum& frustum, const glm::vec3& cameraPosition, float pixelsPerUnit)
+{
+    // the counts copied two frames ago are done by now, reading them doesn't stall
+    frameIndex++;
+    unsigned int lodVisibleCounts[MAX_MESH_LODS] = {};
+    glBindBuffer(GL_COPY_READ_BUFFER, readbackBuffers[frameIndex % 2]);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, lodCount * sizeof(unsigned int), lodVisibleCounts);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    visibleCount = 0;
+    for (unsigned int lod = 0; lod < lodCount; lod++)
+        visibleCount += lodVisibleCounts[lod];
+
+    // the compute shader counts the visible instances into instanceCount
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, drawCommands.size() * sizeof(DrawElementsIndirectCommand), drawCommands.data());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_INSTANCE_BUFFER_BINDING, visibleInstanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_COMMAND_BUFFER_BINDING, drawCommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_LOD_BUFFER_BINDING, instanceLodBuffer);
+
+    cullShader.use();
+    glUniform4fv(cullShader.getUniformLocation(FRUSTUM_PLANES), 6, &frustum.planes[0][0]);
+    cullShader.setInt(INSTANCE_COUNT, static_cast<int>(instanceCount));
+    cullShader.setInt(MESH_COUNT, static_cast<int>(meshCount));
+    cullShader.setVec4(BOUNDING_SPHERE, boundingSphere);
+    cullShader.setVec3(CAMERA_POSITION, cameraPosition);
+    cullShader.setFloat(PIXELS_PER_UNIT, pixelsPerUnit);
+    cullShader.setInt(LOD_COUNT, static_cast<int>(lodCount));
+    glUniform1fv(cullShader.getUniformLocation(LOD_ERRORS), MAX_MESH_LODS, lodErrors);
+    cullShader.setFloat(LOD_PIXEL_ERROR, Mesh::lodPixelError);
+    cullShader.setFloat(LOD_HYSTERESIS, Mesh::LOD_HYSTERESIS);
+    glDispatchCompute((instanceCount + INSTANCE_CULL_GROUP_SIZE - 1) / INSTANCE_CULL_GROUP_SIZE, 1, 1);
+
+    // the draw reads the commands and the vertex shader the compacted list
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // the first mesh's command of every level counts its instances
+    glBindBuffer(GL_COPY_READ_BUFFER, drawCommandBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[frameIndex % 2]);
+    for (unsigned int lod = 0; lod < lodCount; lod++) {
+        size_t command = static_cast<size_t>(lod) * meshCount;
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, command * sizeof(DrawElementsIndirectCommand) + offsetof(DrawElementsIndirectCommand, instanceCount),
+            lod * sizeof(unsigned int), sizeof(unsigned int));
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void InstanceCuller::draw(Shader& shader, const std::vector<Mesh>& meshes) const
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_INSTANCE_BUFFER_BINDING, visibleInstanceBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+
+    // levels without instances have empty commands, drawing them costs less than reading the counts back
+    GeometryPool& pool = GeometryPool::get();
+    for (unsigned int lod = 0; lod < lodCount; lod++) {
+        shader.setInt(VISIBLE_OFFSET, static_cast<int>(lod * instanceCount));
+        size_t firstCommand = static_cast<size_t>(lod) * meshCount;
+        if (pooled) {
+            glBindVertexArray(pool.getVAO());
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(firstCommand * sizeof(DrawElementsIndirectCommand)), static_cast<GLsizei>(meshCount), 0);
+            pool.countDraw(meshCount);
+            continue;
+        }
+        for (size_t i = 0; i < meshes.size(); i++) {
+            meshes[i].bindGeometry();
+            glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>((firstCommand + i) * sizeof(DrawElementsIndirectCommand)));
+            pool.countDraw(1);
+        }
+    }
+    shader.setInt(VISIBLE_OFFSET, 0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,79 @@
+#ifndef INSTANCE_CULLER_H
+#define INSTANCE_CULLER_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "culling.h"
+#include "mesh.h"
+#include "shader.h"
+
+// storage block binding points shared with instance_cull.comp and instanced.vert
+#define INSTANCE_BUFFER_BINDING 5
+#define VISIBLE_INSTANCE_BUFFER_BINDING 6
+#define DRAW_COMMAND_BUFFER_BINDING 7
+#define INSTANCE_LOD_BUFFER_BINDING 8
+
+// Compact 20 byte instance transform, decoded by loadInstance() in instance_cull.comp and instanced.vert.
+// The rotation is stored as the xyz of a unit quaternion with w >= 0 (snorm16), the uniform scale as a half float.
+struct InstanceData {
+    glm::vec3 position;
+    uint32_t rotationXY;
+    uint32_t rotationZScale;
+
+    static InstanceData pack(const glm::vec3& position, const glm::quat& rotation, float scale);
+};
+
+static_assert(sizeof(InstanceData) == 20, "instance_cull.comp and instanced.vert read InstanceData as 5 uints");
+
+// GPU driven instancing: a compute shader frustum culls every instance and compacts the indices of the visible
+// ones into a list, counting them straight into the indirect draw commands. Only visible instances reach the
+// vertex shader and the CPU never touches the instance data after the upload.
+// Meshes with levels of detail get a list and a set of commands per level, the compute shader picks the level
+// of every instance from its projected error like Mesh::selectLod() and keeps it per instance for the hysteresis.
+class InstanceCuller {
+public:
+    // uploads the instance transforms once, meshes are the meshes every instance draws
+    InstanceCuller(const std::vector<InstanceData>& instances, const std::vector<Mesh>& meshes);
+
+    // resets the draw commands, culls every instance against the frustum and selects its level of detail,
+    // pixelsPerUnit is the screen size of one world unit at distance 1
+    void cull(const Frustum& frustum, const glm::vec3& cameraPosition, float pixelsPerUnit);
+    // draws the meshes with the visible instances, the shader reads them through the instance buffers
+    void draw(Shader& shader, const std::vector<Mesh>& meshes) const;
+
+    unsigned int getInstanceCount() const { return instanceCount; }
+    // visible instances of an earlier frame, read back without waiting for the current one
+    unsigned int getVisibleCount() const { return visibleCount; }
+
+private:
+    Shader cullShader;
+
+    unsigned int instanceBuffer;
+    unsigned int visibleInstanceBuffer;
+    unsigned int drawCommandBuffer;
+    // level of detail every instance was drawn with last
+    unsigned int instanceLodBuffer;
+    unsigned int readbackBuffers[2];
+    unsigned int frameIndex = 0;
+
+    // one command per mesh and level, level by level
+    std::vector<DrawElementsIndirectCommand> drawCommands;
+    unsigned int meshCount;
+    // every level is one multi draw with the pool's VAO
+    bool pooled = true;
+    unsigned int lodCount = 1;
+    // largest error of any mesh at every level
+    float lodErrors[MAX_MESH_LODS] = {};
+    // bounding sphere of all meshes in mesh space, xyz center and w radius
+    glm::vec4 boundingSphere;
+    unsigned int instanceCount;
+    unsigned int visibleCount = 0;
+};
+
+#endif
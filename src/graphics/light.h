@@ -14,6 +14,8 @@ public:
     LightType type;
     glm::vec3 color = { 1.0f, 1.0f, 1.0f };
     float intensity = 1.0f;
+    // distance at which point and spot lights fade out completely
+    float range = 10.0f;
     float innerAngle = 30.0f;
     float outerAngle = 45.0f;
     float spotAngle = 30.0f;
@@ -0,0 +1,225 @@
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CLUSTERS_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+static const unsigned int CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+
+LightClusters::LightClusters()
+    : lightBuffer(GL_SHADER_STORAGE_BUFFER, CLUSTER_LIGHT_BUFFER_BINDING)
+    , gridBuffer(GL_SHADER_STORAGE_BUFFER, CLUSTER_GRID_BUFFER_BINDING)
+    , indexBuffer(GL_SHADER_STORAGE_BUFFER, CLUSTER_INDEX_BUFFER_BINDING)
+{
+    boundsMinX.resize(CLUSTER_COUNT);
+    boundsMinY.resize(CLUSTER_COUNT);
+    boundsMinZ.resize(CLUSTER_COUNT);
+    boundsMaxX.resize(CLUSTER_COUNT);
+    boundsMaxY.resize(CLUSTER_COUNT);
+    boundsMaxZ.resize(CLUSTER_COUNT);
+
+    clusterCounts.resize(CLUSTER_COUNT);
+    clusterRanges.resize(CLUSTER_COUNT);
+}
+
+void LightClusters::buildClusterBounds(const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    glm::vec4 key = glm::vec4(projection[0][0], projection[1][1], nearPlane, farPlane);
+    if (key == cachedProjection) {
+        return;
+    }
+    cachedProjection = key;
+
+    float logDepthRange = std::log(farPlane / nearPlane);
+    sliceScale = CLUSTER_GRID_Z / logDepthRange;
+    sliceBias = -CLUSTER_GRID_Z * std::log(nearPlane) / logDepthRange;
+
+    for (unsigned int z = 0; z < CLUSTER_GRID_Z; z++) {
+        // exponential slices keep clusters roughly cube shaped along the view direction
+        float sliceNear = nearPlane * std::pow(farPlane / nearPlane, float(z) / CLUSTER_GRID_Z);
+        float sliceFar = nearPlane * std::pow(farPlane / nearPlane, float(z + 1) / CLUSTER_GRID_Z);
+
+        for (unsigned int y = 0; y < CLUSTER_GRID_Y; y++) {
+            float ndcMinY = -1.0f + 2.0f * y / CLUSTER_GRID_Y;
+            float ndcMaxY = -1.0f + 2.0f * (y + 1) / CLUSTER_GRID_Y;
+
+            for (unsigned int x = 0; x < CLUSTER_GRID_X; x++) {
+                float ndcMinX = -1.0f + 2.0f * x / CLUSTER_GRID_X;
+                float ndcMaxX = -1.0f + 2.0f * (x + 1) / CLUSTER_GRID_X;
+
+                // unproject the tile corners on the near and far plane of the slice
+                float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+                for (float depth : { sliceNear, sliceFar }) {
+                    for (float ndcX : { ndcMinX, ndcMaxX }) {
+                        float viewX = ndcX * depth / projection[0][0];
+                        minX = std::min(minX, viewX);
+                        maxX = std::max(maxX, viewX);
+                    }
+                    for (float ndcY : { ndcMinY, ndcMaxY }) {
+                        float viewY = ndcY * depth / projection[1][1];
+                        minY = std::min(minY, viewY);
+                        maxY = std::max(maxY, viewY);
+                    }
+                }
+
+                unsigned int index = x + CLUSTER_GRID_X * (y + CLUSTER_GRID_Y * z);
+                boundsMinX[index] = minX;
+                boundsMinY[index] = minY;
+                boundsMinZ[index] = -sliceFar;
+                boundsMaxX[index] = maxX;
+                boundsMaxY[index] = maxY;
+                boundsMaxZ[index] = -sliceNear;
+            }
+        }
+    }
+}
+
+void LightClusters::update(const std::vector<ClusteredLight>& lights, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    buildClusterBounds(projection, nearPlane, farPlane);
+
+    assignments.clear();
+    std::fill(clusterCounts.begin(), clusterCounts.end(), 0);
+
+    for (unsigned int i = 0; i < lights.size(); i++) {
+        assignLight(lights[i], i, view, projection, nearPlane, farPlane);
+    }
+
+    // prefix sum of the per cluster counts gives every cluster its slice of the index list
+    stats = Stats();
+    stats.lightCount = static_cast<unsigned int>(lights.size());
+    unsigned int offset = 0;
+    for (unsigned int i = 0; i < CLUSTER_COUNT; i++) {
+        clusterRanges[i] = glm::uvec2(offset, 0);
+        offset += clusterCounts[i];
+        if (clusterCounts[i] > 0) {
+            stats.occupiedClusters++;
+            stats.maxLightsPerCluster = std::max(stats.maxLightsPerCluster, clusterCounts[i]);
+        }
+    }
+    stats.indexCount = offset;
+
+    lightIndices.resize(offset);
+    for (const auto& assignment : assignments) {
+        glm::uvec2& range = clusterRanges[assignment.x];
+        lightIndices[range.x + range.y] = assignment.y;
+        range.y++;
+    }
+
+    lightBuffer.upload(lights);
+    gridBuffer.upload(clusterRanges);
+    indexBuffer.upload(lightIndices);
+}
+
+void LightClusters::bind() const
+{
+    lightBuffer.bind();
+    gridBuffer.bind();
+    indexBuffer.bind();
+}
+
+void LightClusters::assignLight(const ClusteredLight& light, unsigned int lightIndex, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    glm::vec3 center = light.position;
+    float radius = light.range;
+
+    // tightest sphere around the spot cone instead of the whole range sphere, cones wider than a hemisphere keep the range sphere
+    if (light.type == static_cast<int>(ClusteredLightType::SPOT) && light.outerAngleCos > 0.0f) {
+        float cosAngle = light.outerAngleCos;
+        if (cosAngle < 0.7071f) {
+            center = light.position + light.direction * (cosAngle * light.range);
+            radius = std::sqrt(std::max(1.0f - cosAngle * cosAngle, 0.0f)) * light.range;
+        } else {
+            radius = light.range / (2.0f * cosAngle);
+            center = light.position + light.direction * radius;
+        }
+    }
+
+    glm::vec3 viewCenter = glm::vec3(view * glm::vec4(center, 1.0f));
+    float minDepth = -viewCenter.z - radius;
+    float maxDepth = -viewCenter.z + radius;
+    if (maxDepth < nearPlane || minDepth > farPlane) {
+        return;
+    }
+    minDepth = std::max(minDepth, nearPlane);
+    maxDepth = std::min(maxDepth, farPlane);
+
+    int firstSlice = std::clamp(static_cast<int>(std::floor(std::log(minDepth) * sliceScale + sliceBias)), 0, CLUSTER_GRID_Z - 1);
+    int lastSlice = std::clamp(static_cast<int>(std::floor(std::log(maxDepth) * sliceScale + sliceBias)), 0, CLUSTER_GRID_Z - 1);
+
+    // x / depth is monotonic in both, so the screen extent of the sphere's view space box is found at its corners
+    float minNdcX = FLT_MAX, maxNdcX = -FLT_MAX, minNdcY = FLT_MAX, maxNdcY = -FLT_MAX;
+    for (float depth : { minDepth, maxDepth }) {
+        for (float sign : { -1.0f, 1.0f }) {
+            float ndcX = (viewCenter.x + sign * radius) * projection[0][0] / depth;
+            float ndcY = (viewCenter.y + sign * radius) * projection[1][1] / depth;
+            minNdcX = std::min(minNdcX, ndcX);
+            maxNdcX = std::max(maxNdcX, ndcX);
+            minNdcY = std::min(minNdcY, ndcY);
+            maxNdcY = std::max(maxNdcY, ndcY);
+        }
+    }
+    if (maxNdcX < -1.0f || minNdcX > 1.0f || maxNdcY < -1.0f || minNdcY > 1.0f) {
+        return;
+    }
+
+    int firstX = std::clamp(static_cast<int>(std::floor((minNdcX * 0.5f + 0.5f) * CLUSTER_GRID_X)), 0, CLUSTER_GRID_X - 1);
+    int lastX = std::clamp(static_cast<int>(std::floor((maxNdcX * 0.5f + 0.5f) * CLUSTER_GRID_X)), 0, CLUSTER_GRID_X - 1);
+    int firstY = std::clamp(static_cast<int>(std::floor((minNdcY * 0.5f + 0.5f) * CLUSTER_GRID_Y)), 0, CLUSTER_GRID_Y - 1);
+    int lastY = std::clamp(static_cast<int>(std::floor((maxNdcY * 0.5f + 0.5f) * CLUSTER_GRID_Y)), 0, CLUSTER_GRID_Y - 1);
+
+    for (int z = firstSlice; z <= lastSlice; z++) {
+        for (int y = firstY; y <= lastY; y++) {
+            unsigned int rowStart = CLUSTER_GRID_X * (y + CLUSTER_GRID_Y * z);
+            assignRow(rowStart, firstX, lastX, viewCenter, radius, lightIndex);
+        }
+    }
+}
+
+void LightClusters::assignRow(unsigned int rowStart, int first, int last, const glm::vec3& center, float radius, unsigned int lightIndex)
+{
+    float radiusSquared = radius * radius;
+    int x = first;
+
+#ifdef CLUSTERS_USE_SSE
+    // sphere vs box for four clusters of the row at once, rows are a multiple of four wide so loads stay in bounds
+    static_assert(CLUSTER_GRID_X % 4 == 0, "cluster rows must be a multiple of four wide");
+    const __m128 centerX = _mm_set1_ps(center.x);
+    const __m128 centerY = _mm_set1_ps(center.y);
+    const __m128 centerZ = _mm_set1_ps(center.z);
+    const __m128 radius2 = _mm_set1_ps(radiusSquared);
+
+    for (x = first & ~3; x <= last; x += 4) {
+        unsigned int index = rowStart + x;
+        __m128 dx = _mm_sub_ps(centerX, _mm_min_ps(_mm_max_ps(centerX, _mm_loadu_ps(&boundsMinX[index])), _mm_loadu_ps(&boundsMaxX[index])));
+        __m128 dy = _mm_sub_ps(centerY, _mm_min_ps(_mm_max_ps(centerY, _mm_loadu_ps(&boundsMinY[index])), _mm_loadu_ps(&boundsMaxY[index])));
+        __m128 dz = _mm_sub_ps(centerZ, _mm_min_ps(_mm_max_ps(centerZ, _mm_loadu_ps(&boundsMinZ[index])), _mm_loadu_ps(&boundsMaxZ[index])));
+        __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+        int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, radius2));
+        for (int lane = 0; lane < 4; lane++) {
+            int column = x + lane;
+            if (column >= first && column <= last && (mask & (1 << lane))) {
+                clusterCounts[index + lane]++;
+                assignments.push_back(glm::uvec2(index + lane, lightIndex));
+            }
+        }
+    }
+#else
+    for (; x <= last; x++) {
+        unsigned int index = rowStart + x;
+        float dx = center.x - std::clamp(center.x, boundsMinX[index], boundsMaxX[index]);
+        float dy = center.y - std::clamp(center.y, boundsMinY[index], boundsMaxY[index]);
+        float dz = center.z - std::clamp(center.z, boundsMinZ[index], boundsMaxZ[index]);
+        if (dx * dx + dy * dy + dz * dz <= radiusSquared) {
+            clusterCounts[index]++;
+            assignments.push_back(glm::uvec2(index, lightIndex));
+        }
+    }
+#endif
+}
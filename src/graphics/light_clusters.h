@@ -0,0 +1,88 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "uniform_buffer.h"
+
+// SSBO binding points shared with pbr.frag
+#define CLUSTER_LIGHT_BUFFER_BINDING 0
+#define CLUSTER_GRID_BUFFER_BINDING 1
+#define CLUSTER_INDEX_BUFFER_BINDING 2
+
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+
+enum class ClusteredLightType {
+    POINT = 0,
+    SPOT = 1,
+};
+
+// Matches the Light struct in pbr.frag (std430 layout)
+struct ClusteredLight {
+    glm::vec3 position;
+    float range;
+    glm::vec3 color;
+    float intensity;
+    glm::vec3 direction;
+    int type;
+    float innerAngleCos;
+    float outerAngleCos;
+    int shadowIndex;
+    float padding;
+};
+
+// Bins point and spot lights into a view space froxel grid (exponential depth slices), so the PBR pass
+// only has to shade the lights that can reach the cluster a fragment falls into.
+class LightClusters {
+public:
+    struct Stats {
+        unsigned int lightCount = 0;
+        unsigned int indexCount = 0;
+        unsigned int occupiedClusters = 0;
+        unsigned int maxLightsPerCluster = 0;
+    };
+
+    LightClusters();
+
+    void update(const std::vector<ClusteredLight>& lights, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+    // binds the light, grid and index buffers to their SSBO binding points
+    void bind() const;
+
+    // scale and bias turning log(view depth) into a depth slice
+    float getSliceScale() const { return sliceScale; }
+    float getSliceBias() const { return sliceBias; }
+
+    const Stats& getStats() const { return stats; }
+
+private:
+    UniformBuffer lightBuffer;
+    UniformBuffer gridBuffer;
+    UniformBuffer indexBuffer;
+
+    // view space bounds of every cluster as structure of arrays, rebuilt when the projection changes
+    std::vector<float> boundsMinX, boundsMinY, boundsMinZ;
+    std::vector<float> boundsMaxX, boundsMaxY, boundsMaxZ;
+    glm::vec4 cachedProjection = glm::vec4(0.0f);
+
+    float sliceScale = 0.0f;
+    float sliceBias = 0.0f;
+
+    // scratch buffers reused between frames
+    std::vector<unsigned int> clusterCounts;
+    std::vector<glm::uvec2> clusterRanges;
+    std::vector<glm::uvec2> assignments;
+    std::vector<unsigned int> lightIndices;
+
+    Stats stats;
+
+    void buildClusterBounds(const glm::mat4& projection, float nearPlane, float farPlane);
+    void assignLight(const ClusteredLight& light, unsigned int lightIndex, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+    // appends every cluster of a grid row [first, last] that the sphere touches to the assignments
+    void assignRow(unsigned int rowStart, int first, int last, const glm::vec3& center, float radius, unsigned int lightIndex);
+};
+
+#endif
@@ -0,0 +1,324 @@
+#include "material_system.h"
+
+#include <algorithm>
+
+#include <GLFW/glfw3.h>
+#include <spdlog/spdlog.h>
+
+// ARB_bindless_texture isn't part of the generated loader, its entry points are looked up by hand
+typedef GLuint64(APIENTRY* GetTextureHandleProc)(GLuint texture);
+typedef void(APIENTRY* TextureHandleResidencyProc)(GLuint64 handle);
+
+static GetTextureHandleProc getTextureHandle = nullptr;
+static TextureHandleResidencyProc makeTextureHandleResident = nullptr;
+static TextureHandleResidencyProc makeTextureHandleNonResident = nullptr;
+
+static constexpr int INITIAL_ARRAY_LAYERS = 4;
+
+// bytes of one layer with all its levels, the texture has to be bound to GL_TEXTURE_2D
+static size_t getLayerBytes(int levels)
+{
+    int compressed = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+
+    int texelBits = 0;
+    if (!compressed) {
+        int red = 0, green = 0, blue = 0, alpha = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_RED_SIZE, &red);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_GREEN_SIZE, &green);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_BLUE_SIZE, &blue);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_ALPHA_SIZE, &alpha);
+        // drivers pad three channel textures to four
+        texelBits = blue > 0 && alpha == 0 ? red * 4 : red + green + blue + alpha;
+    }
+
+    size_t bytes = 0;
+    for (int level = 0; level < levels; level++) {
+        if (compressed) {
+            int size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            bytes += size;
+        } else {
+            int width = 0, height = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+            bytes += static_cast<size_t>(width) * height * texelBits / 8;
+        }
+    }
+    return bytes;
+}
+
+static int getMaterialMap(const std::string& type)
+{
+    if (type == "albedo_map")
+        return ALBEDO_MAP;
+    else if (type == "normal_map")
+        return NORMAL_MAP;
+    else if (type == "metallic_map")
+        return METALLIC_MAP;
+    else if (type == "roughness_map")
+        return ROUGHNESS_MAP;
+    else if (type == "ao_map")
+        return AO_MAP;
+    else if (type == "emission_map")
+        return EMISSION_MAP;
+    return -1;
+}
+
+MaterialSystem& MaterialSystem::get()
+{
+    static MaterialSystem system;
+    return system;
+}
+
+MaterialSystem::MaterialSystem()
+{
+    if (glfwExtensionSupported("GL_ARB_bindless_texture")) {
+        getTextureHandle = reinterpret_cast<GetTextureHandleProc>(glfwGetProcAddress("glGetTextureHandleARB"));
+        makeTextureHandleResident = reinterpret_cast<TextureHandleResidencyProc>(glfwGetProcAddress("glMakeTextureHandleResidentARB"));
+        makeTextureHandleNonResident = reinterpret_cast<TextureHandleResidencyProc>(glfwGetProcAddress("glMakeTextureHandleNonResidentARB"));
+        bindless = getTextureHandle && makeTextureHandleResident && makeTextureHandleNonResident;
+    }
+
+    if (!bindless) {
+        // the units the material maps were bound to before, then the ones after the shadow maps
+        int maxUnits = 16;
+        glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &maxUnits);
+        for (int unit = 3; unit <= 8; unit++)
+            arrayUnits.push_back(unit);
+        for (int unit = 11; unit < maxUnits && arrayUnits.size() < MAX_MATERIAL_ARRAYS; unit++)
+            arrayUnits.push_back(unit);
+    }
+    spdlog::info("Materials use {}", bindless ? "bindless textures" : "texture arrays");
+
+    glGenBuffers(1, &buffer);
+    // material 0 has no maps
+    MaterialData empty = {};
+    materials.push_back(empty);
+}
+
+unsigned int MaterialSystem::getMaterialIndex(const std::vector<Texture>& textures, TexturePackingCombination packing)
+{
+    std::vector<std::pair<unsigned int, int>> maps;
+    for (const Texture& texture : textures) {
+        int map = getMaterialMap(texture.type);
+        if (map < 0) {
+            spdlog::warn("Unknown texture type: {}", texture.type);
+            continue;
+        }
+        maps.push_back({ texture.id, map });
+    }
+
+    auto key = std::make_pair(maps, static_cast<int>(packing));
+    auto it = materialIndices.find(key);
+    if (it != materialIndices.end())
+        return it->second;
+
+    MaterialData material = {};
+    material.packing = packing;
+    for (const auto& map : maps) {
+        const TextureSlot& slot = addTexture(map.first);
+        if (!slot.valid)
+            continue;
+        material.textures[map.second] = slot.location;
+        material.mapMask |= 1u << map.second;
+    }
+    // ao is read from the red channel of the packed map, see pbr.frag
+    if (packing == TexturePackingCombination::AO_METALLIC_ROUGHNESS && (material.mapMask & (1u << ROUGHNESS_MAP)))
+        material.mapMask |= 1u << AO_MAP;
+
+    unsigned int index;
+    if (!freeMaterials.empty()) {
+        index = freeMaterials.back();
+        freeMaterials.pop_back();
+        materials[index] = material;
+    } else {
+        index = static_cast<unsigned int>(materials.size());
+        materials.push_back(material);
+    }
+    materialIndices.emplace(std::move(key), index);
+    dirty = true;
+    return index;
+}
+
+void MaterialSystem::releaseTexture(unsigned int texture)
+{
+    auto slot = textureSlots.find(texture);
+    if (slot == textureSlots.end())
+        return;
+
+    if (slot->second.valid) {
+        glm::uvec2 location = slot->second.location;
+        if (bindless) {
+            makeTextureHandleNonResident(static_cast<GLuint64>(location.y) << 32 | location.x);
+        } else {
+            arrays[location.x].freeLayers.push_back(static_cast<int>(location.y));
+            arrayBytes -= arrays[location.x].layerBytes;
+        }
+    }
+    textureSlots.erase(slot);
+
+    // the meshes using these are gone, the texture is only deleted once nothing references it
+    for (auto it = materialIndices.begin(); it != materialIndices.end();) {
+        const std::vector<std::pair<unsigned int, int>>& maps = it->first.first;
+        bool usesTexture = std::any_of(maps.begin(), maps.end(), [&](const std::pair<unsigned int, int>& map) { return map.first == texture; });
+        if (usesTexture) {
+            freeMaterials.push_back(it->second);
+            it = materialIndices.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void MaterialSystem::bind(Shader& shader)
+{
+    if (dirty) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(MaterialData), materials.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        dirty = false;
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BUFFER_BINDING, buffer);
+
+    if (bindless)
+        return;
+
+    // every entry gets its own unit even without an array, samplers of different types can't share one
+    static const std::vector<UniformId> arrayUniforms = [] {
+        std::vector<UniformId> uniforms;
+        for (unsigned int i = 0; i < MAX_MATERIAL_ARRAYS; i++)
+            uniforms.push_back(UniformId("materialArrays[" + std::to_string(i) + "]"));
+        return uniforms;
+    }();
+    for (size_t i = 0; i < arrayUnits.size(); i++) {
+        glActiveTexture(GL_TEXTURE0 + arrayUnits[i]);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, i < arrays.size() ? arrays[i].texture : 0);
+        shader.setInt(arrayUniforms[i], arrayUnits[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+std::vector<std::string> MaterialSystem::getShaderDefines() const
+{
+    if (bindless)
+        return { "MATERIALS_BINDLESS" };
+    return {};
+}
+
+MaterialSystem::Stats MaterialSystem::getStats() const
+{
+    Stats stats;
+    stats.bindless = bindless;
+    stats.materialCount = static_cast<unsigned int>(materialIndices.size());
+    stats.textureCount = static_cast<unsigned int>(textureSlots.size());
+    stats.arrayCount = static_cast<unsigned int>(arrays.size());
+    for (const TextureArray& array : arrays)
+        stats.arrayLayers += array.layerCount - array.freeLayers.size();
+    return stats;
+}
+
+const MaterialSystem::TextureSlot& MaterialSystem::addTexture(unsigned int texture)
+{
+    auto it = textureSlots.find(texture);
+    if (it != textureSlots.end())
+        return it->second;
+
+    TextureSlot slot = { glm::uvec2(0), false };
+    // textures that failed to decode have no storage
+    int width = 0;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (width > 0 && bindless) {
+        // the texture's own sampler state is baked into the handle
+        GLuint64 handle = getTextureHandle(texture);
+        if (handle) {
+            makeTextureHandleResident(handle);
+            slot = { glm::uvec2(static_cast<unsigned int>(handle), static_cast<unsigned int>(handle >> 32)), true };
+        }
+    } else if (width > 0) {
+        slot = addToArray(texture);
+    }
+    return textureSlots.emplace(texture, slot).first->second;
+}
+
+MaterialSystem::TextureSlot MaterialSystem::addToArray(unsigned int texture)
+{
+    int width = 0, height = 0, levels = 0, internalFormat = 0;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+    levels = std::max(levels, 1);
+
+    size_t index = 0;
+    while (index < arrays.size()) {
+        const TextureArray& array = arrays[index];
+        if (array.internalFormat == static_cast<GLenum>(internalFormat) && array.width == width && array.height == height && array.levels == levels)
+            break;
+        index++;
+    }
+    if (index == arrays.size()) {
+        if (arrays.size() >= arrayUnits.size()) {
+            glBindTexture(GL_TEXTURE_2D, 0);
+            spdlog::warn("No texture array left for {}x{} textures of format {:#x}, their maps are left out", width, height, internalFormat);
+            return { glm::uvec2(0), false };
+        }
+        TextureArray array;
+        array.internalFormat = internalFormat;
+        array.width = width;
+        array.height = height;
+        array.levels = levels;
+        array.layerBytes = getLayerBytes(levels);
+        arrays.push_back(array);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    TextureArray& array = arrays[index];
+    int layer;
+    if (!array.freeLayers.empty()) {
+        layer = array.freeLayers.back();
+        array.freeLayers.pop_back();
+    } else {
+        if (array.layerCount == array.capacity)
+            growArray(array, std::max(array.capacity * 2, INITIAL_ARRAY_LAYERS));
+        layer = array.layerCount++;
+    }
+    arrayBytes += array.layerBytes;
+
+    // copies keep compressed blocks as they are, no format conversion
+    for (int level = 0; level < levels; level++) {
+        int levelWidth = std::max(width >> level, 1);
+        int levelHeight = std::max(height >> level, 1);
+        glCopyImageSubData(texture, GL_TEXTURE_2D, level, 0, 0, 0, array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, levelWidth, levelHeight, 1);
+    }
+    return { glm::uvec2(static_cast<unsigned int>(index), static_cast<unsigned int>(layer)), true };
+}
+
+void MaterialSystem::growArray(TextureArray& array, int capacity)
+{
+    unsigned int larger;
+    glGenTextures(1, &larger);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, larger);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.levels, array.internalFormat, array.width, array.height, capacity);
+    // the sampler state of UploadImage::createTexture()
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, array.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    if (array.texture) {
+        for (int level = 0; level < array.levels; level++) {
+            int levelWidth = std::max(array.width >> level, 1);
+            int levelHeight = std::max(array.height >> level, 1);
+            glCopyImageSubData(array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, larger, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, levelWidth, levelHeight, array.layerCount);
+        }
+        glDeleteTextures(1, &array.texture);
+    }
+    array.texture = larger;
+    array.capacity = capacity;
+}
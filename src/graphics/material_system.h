@@ -0,0 +1,124 @@
+#ifndef MATERIAL_SYSTEM_H
+#define MATERIAL_SYSTEM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "shader.h"
+
+// SSBO binding point shared with pbr.frag
+#define MATERIAL_BUFFER_BINDING 9
+
+// the maps of a material, in the order of MaterialData::textures
+enum MaterialMap {
+    ALBEDO_MAP = 0,
+    NORMAL_MAP,
+    METALLIC_MAP,
+    ROUGHNESS_MAP,
+    AO_MAP,
+    EMISSION_MAP,
+    MATERIAL_MAP_COUNT,
+};
+
+// one entry of the material buffer, std430 like Material in pbr.frag
+struct MaterialData {
+    // a bindless texture handle, or the texture array and layer holding the map
+    glm::uvec2 textures[MATERIAL_MAP_COUNT];
+    int packing;
+    // bit (1 << MaterialMap) for every map present. The ao bit is also set when ao is packed into another map.
+    unsigned int mapMask;
+};
+
+// sampler array of pbr.frag without bindless textures
+static constexpr unsigned int MAX_MATERIAL_ARRAYS = 16;
+
+// Material parameters and textures of every mesh in one shader storage buffer, indexed by the material index
+// drawn with each mesh (MeshDrawData), so draws bind no textures and any meshes can share one multi draw.
+// Textures are referenced by ARB_bindless_texture handles where the driver has them. Otherwise each texture is
+// copied into a texture array of its format, size and mip count, and the shader picks array and layer; formats
+// beyond MAX_MATERIAL_ARRAYS get no array and their maps count as missing.
+// Materials are shared by meshes with the same textures and packing. Render thread only.
+class MaterialSystem {
+public:
+    struct Stats {
+        bool bindless = false;
+        unsigned int materialCount = 0;
+        unsigned int textureCount = 0;
+        unsigned int arrayCount = 0;
+        size_t arrayLayers = 0;
+    };
+
+    // the first call picks the mode and has to come after the GL functions are loaded
+    static MaterialSystem& get();
+
+    // index of the material made of these textures, created on first use. 0 is a material without maps.
+    unsigned int getMaterialIndex(const std::vector<Texture>& textures, TexturePackingCombination packing);
+    // has to be called before a texture used by materials is deleted, materials using it are dropped
+    void releaseTexture(unsigned int texture);
+
+    // uploads new materials and binds the buffer, and the texture arrays to the shader's sampler array
+    void bind(Shader& shader);
+
+    bool isBindless() const { return bindless; }
+    // video memory of the array layers holding textures, the copies come on top of the textures themselves.
+    // Layers of released textures aren't counted, they are reused before an array grows.
+    size_t getArrayBytes() const { return arrayBytes; }
+    // defines pbr.frag has to be built with, MATERIALS_BINDLESS selects the same path as bind()
+    std::vector<std::string> getShaderDefines() const;
+    Stats getStats() const;
+
+private:
+    struct TextureArray {
+        unsigned int texture = 0;
+        GLenum internalFormat = 0;
+        int width = 0;
+        int height = 0;
+        int levels = 0;
+        // estimated like UploadImage::getResidentBytes()
+        size_t layerBytes = 0;
+        int capacity = 0;
+        int layerCount = 0;
+        // layers of released textures
+        std::vector<int> freeLayers;
+    };
+
+    struct TextureSlot {
+        // handle or array and layer, see MaterialData
+        glm::uvec2 location;
+        bool valid;
+    };
+
+    MaterialSystem();
+
+    bool bindless = false;
+    unsigned int buffer = 0;
+    std::vector<MaterialData> materials;
+    // indices of dropped materials, reused first
+    std::vector<unsigned int> freeMaterials;
+    bool dirty = true;
+
+    // (texture, map) of every map and the packing -> material index
+    std::map<std::pair<std::vector<std::pair<unsigned int, int>>, int>, unsigned int> materialIndices;
+    std::unordered_map<unsigned int, TextureSlot> textureSlots;
+
+    std::vector<TextureArray> arrays;
+    size_t arrayBytes = 0;
+    // texture unit of every entry of the sampler array
+    std::vector<int> arrayUnits;
+
+    const TextureSlot& addTexture(unsigned int texture);
+    // copies the texture into a layer of the array of its format, invalid if there is none and no room for one
+    TextureSlot addToArray(unsigned int texture);
+    static void growArray(TextureArray& array, int capacity);
+};
+
+#endif
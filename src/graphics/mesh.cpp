@@ -1,51 +1,119 @@
 #include "mesh.h"
 
-int TextureTypeToTextureUnit(std::string type);
+#include <algorithm>
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+#include <glm/gtc/packing.hpp>
+
+VertexFormat Mesh::vertexFormat = VertexFormat::QUANTIZED;
+float Mesh::lodPixelError = 1.0f;
+
+// octahedral encoding, the unit sphere folded onto a square. Matches decodeOctahedral() in the shaders.
+static uint32_t packNormal(glm::vec3 normal)
+{
+    // degenerate triangles can leave zero normals, encoded as (0, 0, 1) instead of NaN
+    float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (!(sum > 1e-20f))
+        return glm::packSnorm2x16(glm::vec2(0.0f));
+    normal /= sum;
+    glm::vec2 encoded(normal.x, normal.y);
+    if (normal.z < 0.0f) {
+        glm::vec2 sign(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+        encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * sign;
+    }
+    return glm::packSnorm2x16(encoded);
+}
+
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, AABB aabb)
 {
     this->vertices = vertices;
     this->indices = indices;
     this->textures = textures;
-
-    setupMesh();
+    this->aabb = aabb;
 }
 
-void Mesh::Draw(Shader& shader, TexturePackingCombination texture_packing_combination)
+void Mesh::bindGeometry() const
 {
-    for (unsigned int i = 0; i < textures.size(); i++) {
-        if (texture_packing_combination == TexturePackingCombination::AO_METALLIC_ROUGHNESS && (textures[i].type == "roughness_map" || textures[i].type == "ao_map")) {
-            shader.setBool("has_ao_map", true);
-            continue;
-        }
-        if (texture_packing_combination == TexturePackingCombination::METALLIC_ROUGHNESS && textures[i].type == "roughness_map") {
-            continue;
-        }
-        if (textures[i].type == "emission_map") {
-            shader.setBool("has_emission_map", true);
-        }
-        if (textures[i].type == "ao_map") {
-            shader.setBool("has_ao_map", true);
-        }
-        int textureUnit = TextureTypeToTextureUnit(textures[i].type);
-        glActiveTexture(GL_TEXTURE0 + textureUnit);
-        shader.setInt(textures[i].type, textureUnit);
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    glBindVertexArray(VAO);
+    if (!pooled) {
+        const MeshDrawData& data = GeometryPool::get().getDrawData(drawIndex);
+        glVertexAttrib3fv(3, &data.positionScale[0]);
+        glVertexAttrib3fv(4, &data.positionOffset[0]);
+        glVertexAttribI4ui(5, data.materialIndex, 0, 0, 0);
     }
-    glActiveTexture(GL_TEXTURE0);
+}
 
-    // draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+void Mesh::drawGeometry(unsigned int lod, int instanceCount) const
+{
+    DrawElementsIndirectCommand command = getDrawCommand(lod, instanceCount);
+    const void* indexOffset = reinterpret_cast<const void*>(static_cast<size_t>(command.firstIndex) * sizeof(unsigned int));
+
+    bindGeometry();
+    glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, indexOffset, command.instanceCount, command.baseVertex, command.baseInstance);
     glBindVertexArray(0);
+    GeometryPool::get().countDraw(1);
+}
 
-    // kind of a hack
-    shader.setBool("has_emission_map", false);
-    shader.setBool("has_ao_map", false);
+DrawElementsIndirectCommand Mesh::getDrawCommand(unsigned int lod, unsigned int instanceCount) const
+{
+    const MeshLod& level = lods[std::min<size_t>(lod, lods.size() - 1)];
+    // the base instance selects the mesh's MeshDrawData, see GeometryPool
+    return { level.indexCount, instanceCount, firstIndex + level.firstIndex, baseVertex, drawIndex };
+}
+
+unsigned int Mesh::selectLod(float pixelsPerUnit, unsigned int current) const
+{
+    if (lods.size() < 2 || lodPixelError <= 0.0f)
+        return 0;
+    for (size_t lod = lods.size() - 1; lod > 0; lod--) {
+        float limit = lod > current ? lodPixelError * LOD_HYSTERESIS : lodPixelError;
+        if (lods[lod].error * pixelsPerUnit <= limit)
+            return static_cast<unsigned int>(lod);
+    }
+    return 0;
 }
 
 void Mesh::setupMesh()
 {
+    setupMesh(vertices.data(), vertices.size(), indices.data(), indices.size());
+}
+
+void Mesh::setupMesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount)
+{
+    if (lods.empty())
+        lods.push_back({ 0, static_cast<unsigned int>(indexCount), 0.0f });
+    this->indexCount = lods[0].indexCount;
+
+    format = vertexFormat;
+    MeshDrawData drawData = { glm::vec3(1.0f), glm::vec3(0.0f), materialId };
+    if (format == VertexFormat::QUANTIZED) {
+        // unorm16 steps across the bounds, flat axes are kept from dividing by zero
+        glm::vec3 extent = glm::max(aabb.max - aabb.min, glm::vec3(1e-8f));
+        std::vector<QuantizedVertex> packed(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            glm::vec3 position = glm::clamp((vertexData[i].Position - aabb.min) / extent, 0.0f, 1.0f);
+            for (int axis = 0; axis < 3; axis++)
+                packed[i].Position[axis] = static_cast<uint16_t>(position[axis] * 65535.0f + 0.5f);
+            packed[i].Position[3] = 0;
+            packed[i].Normal = packNormal(vertexData[i].Normal);
+            packed[i].TexCoords = glm::packHalf2x16(vertexData[i].TexCoords);
+        }
+        vertexBufferSize = packed.size() * sizeof(QuantizedVertex);
+        drawData.positionScale = aabb.max - aabb.min;
+        drawData.positionOffset = aabb.min;
+
+        // all quantized meshes share the pool's buffers and VAO
+        GeometryPool& pool = GeometryPool::get();
+        GeometryPool::Allocation allocation = pool.allocate(packed.data(), vertexCount, indexData, indexCount);
+        pooled = true;
+        baseVertex = allocation.baseVertex;
+        firstIndex = allocation.firstIndex;
+        drawIndex = pool.addDrawData(drawData);
+        VAO = pool.getVAO();
+        VBO = 0;
+        EBO = 0;
+        return;
+    }
+
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
@@ -53,41 +121,27 @@ void Mesh::setupMesh()
     glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-        &indices[0], GL_STATIC_DRAW);
+    std::vector<CompactVertex> packed(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        packed[i].Position = vertexData[i].Position;
+        packed[i].Normal = packNormal(vertexData[i].Normal);
+        packed[i].TexCoords = glm::packHalf2x16(vertexData[i].TexCoords);
+    }
+    vertexBufferSize = packed.size() * sizeof(CompactVertex);
+    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, packed.data(), GL_STATIC_DRAW);
 
-    // vertex positions
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    // vertex normals
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)0);
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-    // vertex texture coords
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, Normal));
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, TexCoords));
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
 
     glBindVertexArray(0);
-}
 
-int TextureTypeToTextureUnit(std::string type)
-{
-    if (type == "albedo_map")
-        return 3;
-    else if (type == "normal_map")
-        return 4;
-    else if (type == "metallic_map")
-        return 5;
-    else if (type == "roughness_map")
-        return 6;
-    else if (type == "ao_map")
-        return 7;
-    else if (type == "emission_map")
-        return 8;
-
-    std::cout << "Unknown texture type: " << type << std::endl;
-    assert(false);
-    return 0;
+    // float positions need no scale, the draw sets the constant attributes from here
+    drawIndex = GeometryPool::get().addDrawData(drawData);
 }
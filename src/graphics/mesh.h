@@ -1,6 +1,7 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -8,6 +9,9 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "culling.h"
+#include "geometry_pool.h"
+#include "mesh_optimizer.h"
 #include "shader.h"
 
 enum TexturePackingCombination {
@@ -16,12 +20,47 @@ enum TexturePackingCombination {
     AO_METALLIC_ROUGHNESS = 2,
 };
 
+// full precision vertex, as imported and as stored in the mesh cache
 struct Vertex {
     glm::vec3 Position;
     glm::vec3 Normal;
     glm::vec2 TexCoords;
 };
 
+// Layouts of the vertex buffers on the GPU, Vertex is packed into one of them by setupMesh(). Normals are
+// octahedral encoded in 2 x snorm16 and texture coordinates are half floats in both.
+enum class VertexFormat {
+    // float3 position, 20 bytes, in buffers of the mesh's own
+    COMPACT,
+    // position as 3 x unorm16 within the mesh bounds, 16 bytes, in the GeometryPool
+    QUANTIZED,
+};
+
+struct CompactVertex {
+    glm::vec3 Position;
+    uint32_t Normal;
+    uint32_t TexCoords;
+};
+
+struct QuantizedVertex {
+    // w is padding
+    uint16_t Position[4];
+    uint32_t Normal;
+    uint32_t TexCoords;
+};
+
+// triangles drawn with the selected levels of detail against the full meshes
+struct LodStats {
+    unsigned int triangles = 0;
+    unsigned int fullTriangles = 0;
+
+    void reset()
+    {
+        triangles = 0;
+        fullTriangles = 0;
+    }
+};
+
 struct Texture {
     unsigned int id;
     std::string type;
@@ -34,15 +73,49 @@ public:
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
+    // bounds in model space
+    AABB aabb;
+    // vertex cache efficiency of the import order and of the optimized one, see optimizeMesh()
+    MeshOptimizeStats optimizeStats;
+    // ranges of indices, finest first. setupMesh() makes the whole index buffer the only level if there are none.
+    std::vector<MeshLod> lods;
 
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
-    void Draw(Shader& shader, TexturePackingCombination texture_packing_combination);
+    // only keeps the data, setupMesh() creates the GL objects and may run later on the thread owning the context
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, AABB aabb);
+    void setupMesh();
+    // uploads streams kept elsewhere, e.g. a mapped mesh cache file, the vectors above stay empty
+    void setupMesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount);
+    // binds the VAO, meshes outside of the GeometryPool set their MeshDrawData as constant attributes
+    void bindGeometry() const;
+    // one draw of a level, the shader finds the material through MeshDrawData
+    void drawGeometry(unsigned int lod = 0, int instanceCount = 1) const;
+    // the draw of a level as an indirect command, base vertex and first index are offsets into the pool
+    DrawElementsIndirectCommand getDrawCommand(unsigned int lod, unsigned int instanceCount = 1) const;
 
-    //  render data
-    unsigned int VAO, VBO, EBO;
+    // the coarsest level whose error covers at most lodPixelError pixels, pixelsPerUnit is the size of one model
+    // space unit on screen. Levels coarser than current have to get below LOD_HYSTERESIS of that, so a mesh
+    // doesn't flicker between two levels.
+    unsigned int selectLod(float pixelsPerUnit, unsigned int current) const;
 
-private:
-    void setupMesh();
+    // format of the meshes set up from now on, quantized meshes go into the GeometryPool
+    static VertexFormat vertexFormat;
+    // screen space error allowed for a level of detail, 0 always draws the full mesh
+    static float lodPixelError;
+    static constexpr float LOD_HYSTERESIS = 0.75f;
+
+    //  render data, VBO and EBO are 0 and VAO is the pool's for pooled meshes
+    unsigned int VAO, VBO, EBO;
+    bool pooled = false;
+    int baseVertex = 0;
+    unsigned int firstIndex = 0;
+    // entry of the mesh's MeshDrawData in the GeometryPool
+    unsigned int drawIndex = 0;
+    // entry in the MaterialSystem, set before setupMesh(). 0 is a material without textures.
+    unsigned int materialId = 0;
+    // of the full mesh, the first level
+    unsigned int indexCount = 0;
+    VertexFormat format = VertexFormat::COMPACT;
+    size_t vertexBufferSize = 0;
 };
 
 #endif
@@ -0,0 +1,238 @@
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#include "../utils/hash.h"
+
+// bump whenever the layout or the import changes
+static constexpr uint32_t MESH_CACHE_MAGIC = 0x4843534d; // "MSCH"
+static constexpr uint32_t MESH_CACHE_VERSION = 3;
+
+static size_t alignUp(size_t offset, size_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+uint64_t MeshCache::computeKey(const std::string& path, unsigned int importFlags)
+{
+    uint64_t hash = HASH_SEED;
+    hash = hashBytes(hash, &MESH_CACHE_VERSION, sizeof(MESH_CACHE_VERSION));
+    hash = hashBytes(hash, &importFlags, sizeof(importFlags));
+    hash = hashFile(hash, path);
+
+    // glTF keeps its geometry in separate buffers, hash those as well in a stable order
+    std::filesystem::path source(path);
+    std::vector<std::filesystem::path> buffers;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(source.parent_path(), error)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".bin")
+            buffers.push_back(entry.path());
+    }
+    std::sort(buffers.begin(), buffers.end());
+    for (const auto& buffer : buffers)
+        hash = hashFile(hash, buffer.string());
+
+    return hash;
+}
+
+std::string MeshCache::getPath(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.mesh", static_cast<unsigned long long>(key));
+    return std::string(DIRECTORY) + '/' + name;
+}
+
+bool MeshCache::write(uint64_t key, const std::vector<Mesh>& meshes, const std::vector<Texture>& textures, TexturePackingCombination packing)
+{
+    std::vector<MeshRecord> meshRecords(meshes.size());
+    std::vector<TextureRecord> textureRecords(textures.size());
+    std::vector<uint32_t> meshTextures;
+    std::string strings;
+
+    for (size_t i = 0; i < textures.size(); i++) {
+        textureRecords[i].typeOffset = static_cast<uint32_t>(strings.size());
+        textureRecords[i].typeLength = static_cast<uint32_t>(textures[i].type.size());
+        strings += textures[i].type;
+        textureRecords[i].pathOffset = static_cast<uint32_t>(strings.size());
+        textureRecords[i].pathLength = static_cast<uint32_t>(textures[i].path.size());
+        strings += textures[i].path;
+    }
+
+    size_t offset = sizeof(Header) + meshRecords.size() * sizeof(MeshRecord) + textureRecords.size() * sizeof(TextureRecord);
+    for (const Mesh& mesh : meshes)
+        offset += mesh.textures.size() * sizeof(uint32_t);
+    offset = alignUp(offset + strings.size(), 8);
+
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const Mesh& mesh = meshes[i];
+        MeshRecord& record = meshRecords[i];
+
+        record.firstTexture = static_cast<uint32_t>(meshTextures.size());
+        record.textureCount = static_cast<uint32_t>(mesh.textures.size());
+        for (const Texture& texture : mesh.textures) {
+            // meshes hold copies of the model's textures, store their index instead
+            auto it = std::find_if(textures.begin(), textures.end(), [&](const Texture& loaded) { return loaded.path == texture.path; });
+            meshTextures.push_back(static_cast<uint32_t>(it - textures.begin()));
+        }
+
+        record.vertexOffset = offset;
+        record.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+        offset += mesh.vertices.size() * sizeof(Vertex);
+        record.indexOffset = offset;
+        record.indexCount = static_cast<uint32_t>(mesh.indices.size());
+        offset += mesh.indices.size() * sizeof(unsigned int);
+
+        for (int axis = 0; axis < 3; axis++) {
+            record.aabbMin[axis] = mesh.aabb.min[axis];
+            record.aabbMax[axis] = mesh.aabb.max[axis];
+        }
+        record.optimizeStats = mesh.optimizeStats;
+        record.lodCount = static_cast<uint32_t>(std::min<size_t>(mesh.lods.size(), MAX_MESH_LODS));
+        std::copy(mesh.lods.begin(), mesh.lods.begin() + record.lodCount, record.lods);
+    }
+
+    Header header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.key = key;
+    header.vertexSize = sizeof(Vertex);
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    header.textureCount = static_cast<uint32_t>(textures.size());
+    header.meshTextureCount = static_cast<uint32_t>(meshTextures.size());
+    header.stringSize = static_cast<uint32_t>(strings.size());
+    header.texturePackingCombination = packing;
+
+    std::error_code error;
+    std::filesystem::create_directories(DIRECTORY, error);
+
+    // written next to the entry and renamed, a reader never maps a half written file
+    std::string path = getPath(key);
+    std::string temporaryPath = path + '.' + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char*>(meshRecords.data()), meshRecords.size() * sizeof(MeshRecord));
+        stream.write(reinterpret_cast<const char*>(textureRecords.data()), textureRecords.size() * sizeof(TextureRecord));
+        stream.write(reinterpret_cast<const char*>(meshTextures.data()), meshTextures.size() * sizeof(uint32_t));
+        stream.write(strings.data(), strings.size());
+
+        size_t written = static_cast<size_t>(stream.tellp());
+        const char padding[8] = {};
+        stream.write(padding, alignUp(written, 8) - written);
+
+        for (const Mesh& mesh : meshes) {
+            stream.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+            stream.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+        }
+
+        if (!stream) {
+            spdlog::warn("Failed to write mesh cache {}", path);
+            stream.close();
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    return true;
+}
+
+bool MeshCache::open(uint64_t key)
+{
+    if (!file.open(getPath(key)))
+        return false;
+
+    bool valid = file.size() >= sizeof(Header);
+    if (valid) {
+        const Header& header = getHeader();
+        valid = header.magic == MESH_CACHE_MAGIC && header.version == MESH_CACHE_VERSION && header.key == key && header.vertexSize == sizeof(Vertex);
+    }
+    if (valid) {
+        const Header& header = getHeader();
+        size_t tableSize = sizeof(Header) + header.meshCount * sizeof(MeshRecord) + header.textureCount * sizeof(TextureRecord)
+            + header.meshTextureCount * sizeof(uint32_t) + header.stringSize;
+        valid = tableSize <= file.size();
+        // the streams are written in mesh order, the last one ends the file
+        if (valid && header.meshCount > 0) {
+            const MeshRecord& last = getMeshRecord(header.meshCount - 1);
+            valid = last.indexOffset + last.indexCount * sizeof(unsigned int) <= file.size();
+        }
+    }
+
+    if (!valid) {
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+void MeshCache::read(std::vector<Mesh>& meshes, std::vector<Texture>& textures, TexturePackingCombination& packing) const
+{
+    const Header& header = getHeader();
+    const TextureRecord* textureRecords = reinterpret_cast<const TextureRecord*>(file.data() + sizeof(Header) + header.meshCount * sizeof(MeshRecord));
+    const uint32_t* meshTextures = reinterpret_cast<const uint32_t*>(textureRecords + header.textureCount);
+    const char* strings = reinterpret_cast<const char*>(meshTextures + header.meshTextureCount);
+
+    textures.resize(header.textureCount);
+    for (size_t i = 0; i < textures.size(); i++) {
+        const TextureRecord& record = textureRecords[i];
+        textures[i].id = 0;
+        textures[i].type.assign(strings + record.typeOffset, record.typeLength);
+        textures[i].path.assign(strings + record.pathOffset, record.pathLength);
+    }
+
+    meshes.clear();
+    meshes.reserve(header.meshCount);
+    for (size_t i = 0; i < header.meshCount; i++) {
+        const MeshRecord& record = getMeshRecord(i);
+
+        std::vector<Texture> meshTextureList;
+        for (uint32_t j = 0; j < record.textureCount; j++)
+            meshTextureList.push_back(textures[meshTextures[record.firstTexture + j]]);
+
+        AABB aabb;
+        aabb.min = glm::vec3(record.aabbMin[0], record.aabbMin[1], record.aabbMin[2]);
+        aabb.max = glm::vec3(record.aabbMax[0], record.aabbMax[1], record.aabbMax[2]);
+
+        meshes.push_back(Mesh({}, {}, meshTextureList, aabb));
+        meshes.back().optimizeStats = record.optimizeStats;
+        meshes.back().lods.assign(record.lods, record.lods + std::min<uint32_t>(record.lodCount, MAX_MESH_LODS));
+    }
+
+    packing = static_cast<TexturePackingCombination>(header.texturePackingCombination);
+}
+
+const MeshCache::MeshRecord& MeshCache::getMeshRecord(size_t mesh) const
+{
+    return reinterpret_cast<const MeshRecord*>(file.data() + sizeof(Header))[mesh];
+}
+
+const Vertex* MeshCache::getVertices(size_t mesh) const
+{
+    return reinterpret_cast<const Vertex*>(file.data() + getMeshRecord(mesh).vertexOffset);
+}
+
+size_t MeshCache::getVertexCount(size_t mesh) const
+{
+    return getMeshRecord(mesh).vertexCount;
+}
+
+const unsigned int* MeshCache::getIndices(size_t mesh) const
+{
+    return reinterpret_cast<const unsigned int*>(file.data() + getMeshRecord(mesh).indexOffset);
+}
+
+size_t MeshCache::getIndexCount(size_t mesh) const
+{
+    return getMeshRecord(mesh).indexCount;
+}
@@ -0,0 +1,84 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../utils/mapped_file.h"
+#include "mesh.h"
+
+// On disk cache of imported models, so Assimp and its post processing only run when the source changed.
+// Every model gets one file in cache/, named after a hash of its source files and the import flags. The file is
+// laid out to be used straight from a memory mapping: header, mesh records, texture records, mesh texture
+// indices and strings, then the vertex and index streams of every mesh.
+class MeshCache {
+public:
+    static constexpr const char* DIRECTORY = "cache";
+
+    // hash of the file at path, the .bin buffers next to it (glTF) and the import flags
+    static uint64_t computeKey(const std::string& path, unsigned int importFlags);
+    // stores the processed meshes, textures index the textures vector like Model::textures_loaded
+    static bool write(uint64_t key, const std::vector<Mesh>& meshes, const std::vector<Texture>& textures, TexturePackingCombination packing);
+
+    // maps the entry for key, false if there is none or it was written with another layout
+    bool open(uint64_t key);
+    void close() { file.close(); }
+    bool isOpen() const { return file.isOpen(); }
+
+    // meshes come back without vertices / indices, upload them from getVertices() / getIndices() instead
+    void read(std::vector<Mesh>& meshes, std::vector<Texture>& textures, TexturePackingCombination& packing) const;
+
+    // streams of one mesh, pointing into the mapping, valid until close()
+    const Vertex* getVertices(size_t mesh) const;
+    size_t getVertexCount(size_t mesh) const;
+    const unsigned int* getIndices(size_t mesh) const;
+    size_t getIndexCount(size_t mesh) const;
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t vertexSize;
+        uint32_t meshCount;
+        uint32_t textureCount;
+        uint32_t meshTextureCount;
+        uint32_t stringSize;
+        int32_t texturePackingCombination;
+    };
+
+    struct MeshRecord {
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        // range in the mesh texture indices
+        uint32_t firstTexture;
+        uint32_t textureCount;
+        float aabbMin[3];
+        float aabbMax[3];
+        // measured at import, the streams are stored optimized
+        MeshOptimizeStats optimizeStats;
+        // ranges of the index stream, which holds every level
+        uint32_t lodCount;
+        MeshLod lods[MAX_MESH_LODS];
+    };
+
+    struct TextureRecord {
+        // ranges in the string bytes
+        uint32_t typeOffset;
+        uint32_t typeLength;
+        uint32_t pathOffset;
+        uint32_t pathLength;
+    };
+
+    MappedFile file;
+
+    const Header& getHeader() const { return *reinterpret_cast<const Header*>(file.data()); }
+    const MeshRecord& getMeshRecord(size_t mesh) const;
+
+    static std::string getPath(uint64_t key);
+};
+
+#endif
@@ -0,0 +1,539 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+
+#include "mesh.h"
+
+// the LRU cache Forsyth's scores are tuned for, larger than the FIFO it is measured with
+static constexpr int FORSYTH_CACHE_SIZE = 32;
+
+// FIFO post transform cache, a vertex is cached while fewer than size misses happened since its own
+struct FifoCache {
+    std::vector<unsigned int> timestamps;
+    unsigned int size;
+    unsigned int time;
+
+    FifoCache(size_t vertexCount, unsigned int size)
+        : timestamps(vertexCount, 0)
+        , size(size)
+        , time(size + 1)
+    {
+    }
+
+    // returns the misses of one triangle
+    unsigned int access(const unsigned int* triangle)
+    {
+        unsigned int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int vertex = triangle[k];
+            if (time - timestamps[vertex] > size) {
+                timestamps[vertex] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+    void reset() { time += size + 1; }
+};
+
+VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+    VertexCacheStats stats;
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return stats;
+
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<unsigned char> referenced(vertexCount, 0);
+    size_t misses = 0;
+    size_t uniqueVertices = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        misses += cache.access(indices + t * 3);
+        for (int k = 0; k < 3; k++) {
+            unsigned char& seen = referenced[indices[t * 3 + k]];
+            uniqueVertices += !seen;
+            seen = 1;
+        }
+    }
+
+    stats.acmr = static_cast<float>(misses) / triangleCount;
+    stats.atvr = static_cast<float>(misses) / uniqueVertices;
+    return stats;
+}
+
+// higher for vertices near the front of the cache and for vertices with few triangles left, which finishes
+// them off instead of leaving lone triangles behind
+static float getVertexScore(int cachePosition, unsigned int liveTriangles)
+{
+    if (liveTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // the last triangle's vertices get a fixed score, using them again right away makes a strip like order
+        if (cachePosition < 3)
+            score = 0.75f;
+        else
+            score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+    }
+    return score + 2.0f / std::sqrt(static_cast<float>(liveTriangles));
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // triangles using every vertex, the first liveTriangles[v] of each range are not emitted yet
+    std::vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (unsigned int index : indices)
+        liveTriangles[index]++;
+    std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+    std::vector<unsigned int> vertexTriangles(indices.size());
+    std::vector<unsigned int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        vertexTriangles[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScores[v] = getVertexScore(-1, liveTriangles[v]);
+
+    auto getTriangleScore = [&](size_t triangle) {
+        const unsigned int* vertices = &indices[triangle * 3];
+        return vertexScores[vertices[0]] + vertexScores[vertices[1]] + vertexScores[vertices[2]];
+    };
+
+    size_t bestTriangle = 0;
+    float bestScore = -1.0f;
+    for (size_t t = 0; t < triangleCount; t++) {
+        float score = getTriangleScore(t);
+        if (score > bestScore) {
+            bestScore = score;
+            bestTriangle = t;
+        }
+    }
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    std::vector<unsigned char> emitted(triangleCount, 0);
+    size_t nextUnemitted = 0;
+
+    // room for the triangle pushed in front of a full cache
+    unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+    int cacheCount = 0;
+
+    while (result.size() < indices.size()) {
+        // no cached vertex has triangles left, continue with the next one in input order
+        if (bestTriangle == SIZE_MAX) {
+            while (emitted[nextUnemitted])
+                nextUnemitted++;
+            bestTriangle = nextUnemitted;
+        }
+
+        emitted[bestTriangle] = 1;
+        const unsigned int* triangle = &indices[bestTriangle * 3];
+        result.insert(result.end(), triangle, triangle + 3);
+
+        for (int k = 0; k < 3; k++) {
+            unsigned int vertex = triangle[k];
+            unsigned int* begin = &vertexTriangles[firstTriangle[vertex]];
+            unsigned int* end = begin + liveTriangles[vertex];
+            unsigned int* found = std::find(begin, end, static_cast<unsigned int>(bestTriangle));
+            if (found != end) {
+                std::swap(*found, *(end - 1));
+                liveTriangles[vertex]--;
+            }
+        }
+
+        unsigned int newCache[FORSYTH_CACHE_SIZE + 3];
+        int newCount = 0;
+        for (int k = 0; k < 3; k++)
+            newCache[newCount++] = triangle[k];
+        for (int i = 0; i < cacheCount; i++) {
+            unsigned int vertex = cache[i];
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                newCache[newCount++] = vertex;
+        }
+
+        for (int i = 0; i < newCount; i++) {
+            unsigned int vertex = newCache[i];
+            cachePositions[vertex] = i < FORSYTH_CACHE_SIZE ? i : -1;
+            vertexScores[vertex] = getVertexScore(cachePositions[vertex], liveTriangles[vertex]);
+        }
+        cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+        std::copy(newCache, newCache + cacheCount, cache);
+
+        // only triangles of the vertices whose scores changed can be the next best
+        bestTriangle = SIZE_MAX;
+        bestScore = -1.0f;
+        for (int i = 0; i < cacheCount; i++) {
+            unsigned int vertex = cache[i];
+            const unsigned int* live = &vertexTriangles[firstTriangle[vertex]];
+            for (unsigned int j = 0; j < liveTriangles[vertex]; j++) {
+                float score = getTriangleScore(live[j]);
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestTriangle = live[j];
+                }
+            }
+        }
+    }
+
+    indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, float threshold)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return;
+
+    // hard boundaries, where all three vertices miss the cache the optimizer jumped to a new area
+    std::vector<size_t> hardClusters;
+    FifoCache cache(vertices.size(), VERTEX_CACHE_SIZE);
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (cache.access(&indices[t * 3]) == 3)
+            hardClusters.push_back(t);
+    }
+    if (hardClusters.empty() || hardClusters[0] != 0)
+        hardClusters.insert(hardClusters.begin(), 0);
+    hardClusters.push_back(triangleCount);
+
+    // soft boundaries split hard clusters wherever the ACMR since the last boundary is close enough to the
+    // cluster's own, the cache restarting there costs at most threshold
+    std::vector<size_t> clusters;
+    for (size_t c = 0; c + 1 < hardClusters.size(); c++) {
+        size_t begin = hardClusters[c];
+        size_t end = hardClusters[c + 1];
+
+        cache.reset();
+        size_t clusterMisses = 0;
+        for (size_t t = begin; t < end; t++)
+            clusterMisses += cache.access(&indices[t * 3]);
+        float clusterACMR = static_cast<float>(clusterMisses) / (end - begin);
+
+        cache.reset();
+        clusters.push_back(begin);
+        size_t misses = 0;
+        size_t count = 0;
+        for (size_t t = begin; t < end; t++) {
+            misses += cache.access(&indices[t * 3]);
+            count++;
+            if (t + 1 < end && misses <= clusterACMR * threshold * count) {
+                clusters.push_back(t + 1);
+                cache.reset();
+                misses = 0;
+                count = 0;
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // area weighted centroid and normal of every cluster
+    size_t clusterCount = clusters.size() - 1;
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+    std::vector<float> areas(clusterCount, 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++) {
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            const glm::vec3& a = vertices[indices[t * 3]].Position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& p = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 normal = glm::cross(b - a, p - a);
+            float area = glm::length(normal);
+            centroids[c] += (a + b + p) * (area / 3.0f);
+            normals[c] += normal;
+            areas[c] += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += areas[c];
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // clusters far out along their normal are likely in front of the rest, draw them first
+    std::vector<float> keys(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; c++) {
+        float normalLength = glm::length(normals[c]);
+        if (areas[c] > 0.0f && normalLength > 0.0f)
+            keys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / normalLength);
+    }
+
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c : order)
+        result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    indices.swap(result);
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    std::vector<unsigned int> remap(vertices.size(), UINT_MAX);
+    std::vector<Vertex> ordered;
+    ordered.reserve(vertices.size());
+    for (unsigned int& index : indices) {
+        if (remap[index] == UINT_MAX) {
+            remap[index] = static_cast<unsigned int>(ordered.size());
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(ordered);
+}
+
+MeshOptimizeStats optimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    MeshOptimizeStats stats;
+    stats.triangleCount = static_cast<unsigned int>(indices.size() / 3);
+    stats.before = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(vertices, indices);
+
+    stats.after = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    return stats;
+}
+
+// sum of squared distances to the planes of a vertex's triangles, weighted by their area
+struct Quadric {
+    // symmetric 3x3 part, then the linear part and the constant
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+    double weight = 0.0;
+
+    void addPlane(const glm::dvec3& normal, double distance, double planeWeight)
+    {
+        a00 += planeWeight * normal.x * normal.x;
+        a01 += planeWeight * normal.x * normal.y;
+        a02 += planeWeight * normal.x * normal.z;
+        a11 += planeWeight * normal.y * normal.y;
+        a12 += planeWeight * normal.y * normal.z;
+        a22 += planeWeight * normal.z * normal.z;
+        b0 += planeWeight * normal.x * distance;
+        b1 += planeWeight * normal.y * distance;
+        b2 += planeWeight * normal.z * distance;
+        c += planeWeight * distance * distance;
+        weight += planeWeight;
+    }
+
+    void add(const Quadric& other)
+    {
+        a00 += other.a00;
+        a01 += other.a01;
+        a02 += other.a02;
+        a11 += other.a11;
+        a12 += other.a12;
+        a22 += other.a22;
+        b0 += other.b0;
+        b1 += other.b1;
+        b2 += other.b2;
+        c += other.c;
+        weight += other.weight;
+    }
+
+    // root mean square distance of point to the planes
+    float getError(const glm::vec3& point) const
+    {
+        double x = point.x, y = point.y, z = point.z;
+        double squared = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+            + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return weight > 0.0 ? static_cast<float>(std::sqrt(std::max(squared, 0.0) / weight)) : 0.0f;
+    }
+};
+
+struct Collapse {
+    unsigned int from;
+    unsigned int to;
+    float error;
+};
+
+// vertices on edges used by any other number of triangles than two, open borders and attribute seams
+static std::vector<unsigned char> findLockedVertices(const std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    std::vector<std::pair<unsigned int, unsigned int>> edges;
+    edges.reserve(indices.size());
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        for (int k = 0; k < 3; k++) {
+            unsigned int a = indices[i + k];
+            unsigned int b = indices[i + (k + 1) % 3];
+            edges.push_back({ std::min(a, b), std::max(a, b) });
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    std::vector<unsigned char> locked(vertexCount, 0);
+    for (size_t i = 0; i < edges.size();) {
+        size_t j = i + 1;
+        while (j < edges.size() && edges[j] == edges[i])
+            j++;
+        if (j - i != 2) {
+            locked[edges[i].first] = 1;
+            locked[edges[i].second] = 1;
+        }
+        i = j;
+    }
+    return locked;
+}
+
+// moving from onto to must not turn any of from's remaining triangles around
+static bool flipsTriangles(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const unsigned int* triangles, unsigned int triangleCount, unsigned int from, unsigned int to)
+{
+    for (unsigned int i = 0; i < triangleCount; i++) {
+        const unsigned int* triangle = &indices[triangles[i] * 3];
+        // removed by the collapse
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+            continue;
+
+        glm::vec3 before[3], after[3];
+        for (int k = 0; k < 3; k++) {
+            before[k] = vertices[triangle[k]].Position;
+            after[k] = triangle[k] == from ? vertices[to].Position : before[k];
+        }
+        glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+        glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+        if (glm::dot(normalBefore, normalAfter) <= 0.0f)
+            return true;
+    }
+    return false;
+}
+
+// one round of the cheapest collapses that don't share triangles, returns how many were made
+static size_t collapseEdges(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, std::vector<Quadric>& quadrics, const std::vector<unsigned char>& locked, size_t targetIndexCount, float maxError, float& error)
+{
+    size_t vertexCount = vertices.size();
+    std::vector<unsigned int> triangleCounts(vertexCount, 0);
+    for (unsigned int index : indices)
+        triangleCounts[index]++;
+    std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        firstTriangle[v + 1] = firstTriangle[v] + triangleCounts[v];
+    std::vector<unsigned int> vertexTriangles(indices.size());
+    std::vector<unsigned int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        vertexTriangles[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+    // every edge in both directions, the vertex stays where to is and keeps its attributes
+    std::vector<Collapse> collapses;
+    collapses.reserve(indices.size() * 2);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        for (int k = 0; k < 3; k++) {
+            unsigned int a = indices[i + k];
+            unsigned int b = indices[i + (k + 1) % 3];
+            for (int direction = 0; direction < 2; direction++) {
+                unsigned int from = direction ? b : a;
+                unsigned int to = direction ? a : b;
+                if (locked[from])
+                    continue;
+                Quadric merged = quadrics[from];
+                merged.add(quadrics[to]);
+                collapses.push_back({ from, to, merged.getError(vertices[to].Position) });
+            }
+        }
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+    // a collapse removes two triangles of a closed surface
+    size_t neededCollapses = (indices.size() - targetIndexCount) / 6 + 1;
+    std::vector<unsigned int> remap(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        remap[v] = static_cast<unsigned int>(v);
+    // vertices of triangles changed this round, their flip tests are out of date
+    std::vector<unsigned char> touched(vertexCount, 0);
+
+    size_t collapseCount = 0;
+    for (const Collapse& collapse : collapses) {
+        if (collapseCount >= neededCollapses || collapse.error > maxError)
+            break;
+        if (touched[collapse.from] || touched[collapse.to])
+            continue;
+
+        const unsigned int* triangles = &vertexTriangles[firstTriangle[collapse.from]];
+        unsigned int triangleCount = triangleCounts[collapse.from];
+        if (flipsTriangles(vertices, indices, triangles, triangleCount, collapse.from, collapse.to))
+            continue;
+
+        remap[collapse.from] = collapse.to;
+        quadrics[collapse.to].add(quadrics[collapse.from]);
+        for (unsigned int i = 0; i < triangleCount; i++) {
+            for (int k = 0; k < 3; k++)
+                touched[indices[triangles[i] * 3 + k]] = 1;
+        }
+        error = std::max(error, collapse.error);
+        collapseCount++;
+    }
+
+    // triangles that lost a corner are gone
+    size_t written = 0;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        unsigned int a = remap[indices[i]];
+        unsigned int b = remap[indices[i + 1]];
+        unsigned int c = remap[indices[i + 2]];
+        if (a == b || b == c || c == a)
+            continue;
+        indices[written++] = a;
+        indices[written++] = b;
+        indices[written++] = c;
+    }
+    indices.resize(written);
+    return collapseCount;
+}
+
+std::vector<MeshLod> generateLods(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, unsigned int maxLods, float maxError)
+{
+    std::vector<MeshLod> lods;
+    lods.push_back({ 0, static_cast<unsigned int>(indices.size()), 0.0f });
+    if (indices.size() < 3)
+        return lods;
+
+    std::vector<Quadric> quadrics(vertices.size());
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        glm::dvec3 a(vertices[indices[i]].Position);
+        glm::dvec3 b(vertices[indices[i + 1]].Position);
+        glm::dvec3 c(vertices[indices[i + 2]].Position);
+        glm::dvec3 normal = glm::cross(b - a, c - a);
+        double area = glm::length(normal);
+        if (area <= 0.0)
+            continue;
+        normal /= area;
+        for (int k = 0; k < 3; k++)
+            quadrics[indices[i + k]].addPlane(normal, -glm::dot(normal, a), area);
+    }
+
+    std::vector<unsigned char> locked = findLockedVertices(indices, vertices.size());
+    // every level continues from the one before, the quadrics keep measuring against the full mesh
+    std::vector<unsigned int> simplified(indices);
+    float error = 0.0f;
+    while (lods.size() < maxLods) {
+        size_t previousCount = simplified.size();
+        size_t targetCount = previousCount / 6 * 3;
+        while (simplified.size() > targetCount) {
+            if (collapseEdges(vertices, simplified, quadrics, locked, targetCount, maxError, error) == 0)
+                break;
+        }
+        if (simplified.empty() || simplified.size() * 4 > previousCount * 3)
+            break;
+
+        std::vector<unsigned int> level(simplified);
+        optimizeVertexCache(level, vertices.size());
+        lods.push_back({ static_cast<unsigned int>(indices.size()), static_cast<unsigned int>(level.size()), error });
+        indices.insert(indices.end(), level.begin(), level.end());
+    }
+    return lods;
+}
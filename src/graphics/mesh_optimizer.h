@@ -0,0 +1,58 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <vector>
+
+struct Vertex;
+
+// Import time processing of triangle lists, run once by Model::processMesh() and stored in the mesh cache.
+
+// entries of the FIFO post transform cache the statistics are measured with
+static constexpr unsigned int VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats {
+    // average cache miss ratio, vertex shader invocations per triangle (0.5 at best, 3 at worst)
+    float acmr = 0.0f;
+    // average transform to vertex ratio, vertex shader invocations per referenced vertex (1 at best)
+    float atvr = 0.0f;
+};
+
+// levels of detail of a mesh, including the full one
+static constexpr unsigned int MAX_MESH_LODS = 4;
+
+// one level of detail, a range of the mesh's index buffer drawn with the same vertices
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    // estimated distance of the simplified surface from the original, in model space
+    float error;
+};
+
+struct MeshOptimizeStats {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    unsigned int triangleCount = 0;
+};
+
+// simulates a FIFO cache of cacheSize entries over the triangle list
+VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// reorders triangles for the post transform cache, Forsyth's linear speed vertex cache optimisation
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+// splits cache optimized triangles into clusters and draws the outward facing ones first, so they occlude the
+// rest of the mesh. threshold is the ACMR increase allowed for the extra cluster boundaries.
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, float threshold = 1.05f);
+// moves vertices into the order the triangles first use them and drops unreferenced ones
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// all of the above in order, returns the cache statistics before and after
+MeshOptimizeStats optimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// Simplifies the triangles with quadric error metric edge collapses and appends up to maxLods - 1 levels to
+// indices, each with about half the triangles of the one before and reordered for the vertex cache. Vertices on
+// open edges, which include UV and normal seams, are never moved. A level that can't get below three quarters of
+// the one before without exceeding maxError ends the chain. Returns every level, the first one is the full mesh.
+std::vector<MeshLod> generateLods(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, unsigned int maxLods, float maxError);
+
+#endif
@@ -1,30 +1,268 @@
 #include "model.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
 #include <stb_image.h>
 
-unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma = false);
+#include "common.h"
+#include "material_system.h"
+#include "texture_cache.h"
+
+static constexpr UniformId IS_REFRACTIVE("isRefractive");
+
+// simplification stops once a level is off by this much of the mesh's bounds diagonal
+static constexpr float MAX_LOD_RELATIVE_ERROR = 0.05f;
 
 void Model::Draw(Shader& shader)
 {
-    shader.setInt("texture_packing_combination", texture_packing_combination);
-    shader.setBool("isRefractive", isRefractive);
-    for (Mesh& mesh : meshes)
-        mesh.Draw(shader, texture_packing_combination);
-    shader.setInt("texture_packing_combination", TexturePackingCombination::NONE);
+    Draw(shader, std::vector<unsigned char>(meshes.size(), 1));
+}
+
+void Model::Draw(Shader& shader, const std::vector<unsigned char>& visibility, int instanceCount)
+{
+    shader.setBool(IS_REFRACTIVE, isRefractive);
+    DrawDepth(visibility, instanceCount);
 }
 
-void Model::loadModel(std::string path)
+void Model::DrawDepth(const std::vector<unsigned char>& visibility, int instanceCount)
 {
+    // materials come from the MaterialSystem, so every pooled mesh goes into the same draw
+    drawCommands.clear();
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (!visibility[i])
+            continue;
+        if (meshes[i].pooled && GeometryPool::multiDrawEnabled)
+            drawCommands.push_back(meshes[i].getDrawCommand(getLod(i), instanceCount));
+        else
+            meshes[i].drawGeometry(getLod(i), instanceCount);
+    }
+    GeometryPool::get().multiDraw(drawCommands);
+}
+
+void Model::submit(RenderQueue& queue, RenderPass pass, Shader& shader, const std::vector<unsigned char>& visibility, float depth)
+{
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (!visibility[i])
+            continue;
+
+        DrawPacket packet;
+        // one depth for the whole model keeps its meshes next to each other, so they can share a multi draw
+        unsigned int material = pass == RenderPass::SHADOW ? 0 : meshes[i].materialId;
+        packet.key = RenderQueue::makeKey(pass, shader.ID, depth, material);
+        packet.shader = &shader;
+        packet.mesh = &meshes[i];
+        packet.modelMatrix = &transform.modelMatrix;
+        packet.lod = getLod(i);
+        packet.instanceCount = 1;
+        packet.isRefractive = isRefractive;
+        queue.submit(packet);
+    }
+}
+
+void Model::updateBounds()
+{
+    bounds = AABB();
+    meshBounds.resize(meshes.size());
+    meshWorldBounds.resize(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        AABB worldBounds = meshes[i].aabb.transformed(transform.modelMatrix);
+        meshBounds.set(i, worldBounds);
+        meshWorldBounds[i] = worldBounds;
+        bounds.expand(worldBounds);
+    }
+}
+
+void Model::selectLods(const glm::vec3& cameraPosition, float pixelsPerUnit, const std::vector<unsigned char>& visibility, LodStats& stats)
+{
+    // errors are in model space, the largest axis scale is the worst case
+    const glm::mat4& matrix = transform.modelMatrix;
+    float scale = glm::max(glm::length(glm::vec3(matrix[0])), glm::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+
+    lodLevels.resize(meshes.size(), 0);
+    for (size_t i = 0; i < meshes.size() && i < meshWorldBounds.size(); i++) {
+        // the closest point of the bounds, the camera inside them gets the full mesh
+        const AABB& worldBounds = meshWorldBounds[i];
+        float distance = glm::length(glm::max(glm::max(worldBounds.min - cameraPosition, cameraPosition - worldBounds.max), glm::vec3(0.0f)));
+        unsigned int lod = 0;
+        if (distance > 0.0f)
+            lod = meshes[i].selectLod(pixelsPerUnit * scale / distance, lodLevels[i]);
+        lodLevels[i] = static_cast<unsigned char>(lod);
+
+        if (i < visibility.size() && visibility[i]) {
+            const Mesh& mesh = meshes[i];
+            stats.fullTriangles += mesh.indexCount / 3;
+            stats.triangles += mesh.lods.empty() ? 0 : mesh.lods[std::min<size_t>(lod, mesh.lods.size() - 1)].indexCount / 3;
+        }
+    }
+}
+
+void Model::cull(const Frustum& frustum, std::vector<unsigned char>& visibility, CullStats& stats) const
+{
+    unsigned int meshCount = static_cast<unsigned int>(meshes.size());
+
+    // the whole model is outside, no need to test every mesh
+    if (!bounds.isValid() || !frustum.intersects(bounds)) {
+        visibility.assign(meshCount, 0);
+        stats.culled += meshCount;
+        return;
+    }
+
+    unsigned int visibleCount = static_cast<unsigned int>(cullAABBs(frustum, meshBounds, visibility));
+    stats.drawn += visibleCount;
+    stats.culled += meshCount - visibleCount;
+}
+
+Model::~Model()
+{
+    // images decoded but never uploaded, the model was dropped while loading
+    for (DecodedImage& image : decodedImages) {
+        stbi_image_free(image.data);
+        TextureUploader::get().release(image.staged);
+    }
+
+    for (size_t i = 0; i < textures_loaded.size(); i++) {
+        if (textures_loaded[i].id)
+            TextureCache::get().release(getTextureKey(i));
+    }
+}
+
+bool Model::parse(const std::string& path)
+{
+    const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | aiProcess_RemoveRedundantMaterials | aiProcess_GenBoundingBoxes;
+    directory = path.substr(0, path.find_last_of('/'));
+
+    // the streams stay in the mapping and are uploaded from there, see uploadStep()
+    uint64_t cacheKey = MeshCache::computeKey(path, importFlags);
+    if (meshCache.open(cacheKey)) {
+        meshCache.read(meshes, textures_loaded, texture_packing_combination);
+        decodedImages.resize(textures_loaded.size());
+        logOptimizeStats(path, true);
+        return true;
+    }
+
     Assimp::Importer import;
-    const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | aiProcess_RemoveRedundantMaterials | aiProcess_GenBoundingBoxes);
+    const aiScene* scene = import.ReadFile(path, importFlags);
 
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
         std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
-        return;
+        return false;
     }
-    directory = path.substr(0, path.find_last_of('/'));
 
     processNode(scene->mRootNode, scene);
+    decodedImages.resize(textures_loaded.size());
+    logOptimizeStats(path, false);
+
+    MeshCache::write(cacheKey, meshes, textures_loaded, texture_packing_combination);
+    return true;
+}
+
+void Model::decodeTexture(size_t index)
+{
+    // resident already, from another model or an earlier load of this one
+    textures_loaded[index].id = TextureCache::get().acquire(getTextureKey(index));
+    if (textures_loaded[index].id)
+        return;
+
+    std::string filename = directory + '/' + textures_loaded[index].path;
+
+    DecodedImage& image = decodedImages[index];
+    const unsigned char* pixels;
+    // cooked textures are stored the way the source is, top row first
+    if (!flipTextures && image.compressed.load(getCookedTexturePath(filename))) {
+        image.layout = UploadImage::fromCompressed(image.compressed);
+        pixels = image.compressed.data.data();
+    } else {
+        int width, height, components;
+        image.data = stbi_load(filename.c_str(), &width, &height, &components, 0);
+        if (!image.data) {
+            std::cout << "Texture failed to load at path: " << textures_loaded[index].path << std::endl;
+            return;
+        }
+        if (flipTextures)
+            flipImageVertically(image.data, width, height, components);
+        image.layout = UploadImage::fromPixels(width, height, components);
+        pixels = image.data;
+    }
+
+    // copy into the upload ring now, so the render thread only issues the upload
+    image.staged = TextureUploader::get().allocate(image.layout.size, true);
+    if (!image.staged.isValid())
+        return;
+    std::memcpy(image.staged.data, pixels, image.layout.size);
+    stbi_image_free(image.data);
+    image.data = nullptr;
+    image.compressed.clear();
+}
+
+bool Model::uploadStep()
+{
+    if (uploadedTextures < textures_loaded.size()) {
+        Texture& texture = textures_loaded[uploadedTextures];
+        DecodedImage& image = decodedImages[uploadedTextures];
+
+        // acquired from the cache when decoding
+        if (texture.id) {
+            uploadedTextures++;
+            return false;
+        }
+
+        size_t bytes = 0;
+        if (image.layout.levels.empty()) {
+            glGenTextures(1, &uploadingTexture);
+        } else {
+            // big textures take several steps, see TextureUpload
+            if (!uploadingTexture) {
+                uploadingTexture = image.layout.createTexture();
+                const unsigned char* pixels = image.compressed.isValid() ? image.compressed.data.data() : image.data;
+                textureUpload = TextureUpload(uploadingTexture, image.layout, pixels, image.staged);
+            }
+            if (!textureUpload.step())
+                return false;
+            bytes = image.layout.getResidentBytes();
+        }
+        // a model decoding the same file at the same time may have inserted it first, then that one is used
+        texture.id = TextureCache::get().insert(getTextureKey(uploadedTextures), uploadingTexture, bytes);
+        uploadingTexture = 0;
+        uploadedTextures++;
+
+        // the upload released the staged copy
+        image.staged = {};
+        stbi_image_free(image.data);
+        image.data = nullptr;
+        image.compressed.clear();
+        return false;
+    }
+
+    if (uploadedMeshes < meshes.size()) {
+        Mesh& mesh = meshes[uploadedMeshes];
+        uploadedMeshes++;
+
+        // meshes copied their textures before these had ids, every texture is uploaded by now
+        for (Texture& texture : mesh.textures) {
+            for (const Texture& loaded : textures_loaded) {
+                if (loaded.path == texture.path) {
+                    texture.id = loaded.id;
+                    break;
+                }
+            }
+        }
+        mesh.materialId = MaterialSystem::get().getMaterialIndex(mesh.textures, texture_packing_combination);
+        if (meshCache.isOpen()) {
+            size_t index = uploadedMeshes - 1;
+            mesh.setupMesh(meshCache.getVertices(index), meshCache.getVertexCount(index), meshCache.getIndices(index), meshCache.getIndexCount(index));
+        } else {
+            mesh.setupMesh();
+        }
+
+        if (uploadedMeshes < meshes.size())
+            return false;
+        meshCache.close();
+        return true;
+    }
+
+    return true;
 }
 
 void Model::processNode(aiNode* node, const aiScene* scene)
@@ -110,7 +348,19 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
         }
     }
 
-    return Mesh(vertices, indices, textures);
+    AABB aabb;
+    aabb.min = glm::vec3(mesh->mAABB.mMin.x, mesh->mAABB.mMin.y, mesh->mAABB.mMin.z);
+    aabb.max = glm::vec3(mesh->mAABB.mMax.x, mesh->mAABB.mMax.y, mesh->mAABB.mMax.z);
+
+    // the optimized order and the levels of detail are what the mesh cache stores, this only runs on a cache miss
+    MeshOptimizeStats optimizeStats = optimizeMesh(vertices, indices);
+    float maxLodError = glm::length(aabb.max - aabb.min) * MAX_LOD_RELATIVE_ERROR;
+    std::vector<MeshLod> lods = generateLods(vertices, indices, MAX_MESH_LODS, maxLodError);
+
+    Mesh result(vertices, indices, textures, aabb);
+    result.optimizeStats = optimizeStats;
+    result.lods = lods;
+    return result;
 }
 
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
@@ -119,59 +369,48 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType
     for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
         aiString str;
         mat->GetTexture(type, i, &str);
-        bool skip = false;
-        for (unsigned int j = 0; j < textures_loaded.size(); j++) {
-            if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) {
-                textures.push_back(textures_loaded[j]);
-                skip = true;
-                break;
-            }
-        }
-        if (!skip) { // if texture hasn't been loaded already, load it
+        auto loaded = textureIndices.find(str.C_Str());
+        if (loaded != textureIndices.end()) {
+            textures.push_back(textures_loaded[loaded->second]);
+        } else { // if texture hasn't been loaded already, load it
             Texture texture;
-            texture.id = TextureFromFile(str.C_Str(), directory);
+            // decoded and uploaded later, see decodeTexture() and uploadStep()
+            texture.id = 0;
             texture.type = typeName;
             texture.path = str.C_Str();
             textures.push_back(texture);
+            textureIndices.emplace(texture.path, textures_loaded.size());
             textures_loaded.push_back(texture); // add to loaded textures
         }
     }
     return textures;
 }
 
-unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma)
+void Model::logOptimizeStats(const std::string& path, bool cached) const
 {
-    std::string filename = std::string(path);
-    filename = directory + '/' + filename;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    } else {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+    // summed over all meshes, the ratios are taken of the totals
+    unsigned int triangles = 0;
+    float transformedBefore = 0.0f, transformedAfter = 0.0f;
+    float referencedBefore = 0.0f, referencedAfter = 0.0f;
+    for (const Mesh& mesh : meshes) {
+        const MeshOptimizeStats& stats = mesh.optimizeStats;
+        if (stats.triangleCount == 0 || stats.before.atvr <= 0.0f || stats.after.atvr <= 0.0f)
+            continue;
+        triangles += stats.triangleCount;
+        transformedBefore += stats.before.acmr * stats.triangleCount;
+        transformedAfter += stats.after.acmr * stats.triangleCount;
+        referencedBefore += stats.before.acmr * stats.triangleCount / stats.before.atvr;
+        referencedAfter += stats.after.acmr * stats.triangleCount / stats.after.atvr;
     }
+    if (triangles == 0)
+        return;
 
-    return textureID;
+    spdlog::info("Vertex cache of {} ({} triangles{}): ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}", path, triangles,
+        cached ? ", cached" : "", transformedBefore / triangles, transformedAfter / triangles,
+        transformedBefore / referencedBefore, transformedAfter / referencedAfter);
+}
+
+std::string Model::getTextureKey(size_t index) const
+{
+    return TextureCache::makeKey(directory + '/' + textures_loaded[index].path, flipTextures);
 }
@@ -2,37 +2,120 @@
 #define MODEL_H
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
+#include "compressed_texture.h"
 #include "entity.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "render_queue.h"
+#include "texture_uploader.h"
 
 class Model : public Entity {
 public:
-    Model(std::string name, const char* path)
+    // loads everything right away, needs a current GL context
+    Model(std::string name, const char* path, bool flipTextures = false)
         : Entity(name)
     {
-        loadModel(path);
+        this->flipTextures = flipTextures;
+        parse(path);
+        for (size_t i = 0; i < textures_loaded.size(); i++)
+            decodeTexture(i);
+        while (!uploadStep()) {
+            // no frame ends in between, wait for ring space right here
+            if (textureUpload.isStalled())
+                TextureUploader::get().waitForSpace();
+        }
     }
+    // an empty model, filled in by the AssetLoader
+    explicit Model(std::string name)
+        : Entity(name)
+    {
+    }
+    ~Model();
+
+    // Loading in steps, parse() and decodeTexture() don't touch GL and may run on worker threads.
+    // reads the scene, meshes reference their textures by path until they are uploaded
+    bool parse(const std::string& path);
+    // decodes one entry of textures_loaded into memory unless the TextureCache has it, different entries may be
+    // decoded concurrently
+    void decodeTexture(size_t index);
+    // uploads one texture or mesh to the GPU, returns true once the whole model is ready to draw
+    bool uploadStep();
+
     void Draw(Shader& shader);
+    // draws only the meshes whose visibility entry is set, see cull(). All pooled meshes are drawn with one multi
+    // draw, see GeometryPool, their materials are found through the MaterialSystem.
+    void Draw(Shader& shader, const std::vector<unsigned char>& visibility, int instanceCount = 1);
+    // like Draw() without the model's uniforms, with whatever shader is bound, e.g. for shadow maps
+    void DrawDepth(const std::vector<unsigned char>& visibility, int instanceCount = 1);
+    // adds a packet for every visible mesh, depth is the model's distance along the pass's view
+    void submit(RenderQueue& queue, RenderPass pass, Shader& shader, const std::vector<unsigned char>& visibility, float depth);
+
+    // recomputes world space bounds of the model and all of its meshes
+    void updateBounds() override;
+    // fills visibility with one entry per mesh, tested against the world space mesh bounds
+    void cull(const Frustum& frustum, std::vector<unsigned char>& visibility, CullStats& stats) const;
+    // picks the level of detail every mesh is drawn with from now on, by the projected error at the closest point
+    // of its bounds. pixelsPerUnit is the screen size of one world unit at distance 1, stats count visible meshes.
+    void selectLods(const glm::vec3& cameraPosition, float pixelsPerUnit, const std::vector<unsigned char>& visibility, LodStats& stats);
+    // one entry per mesh, the full meshes until selectLods() runs
+    const std::vector<unsigned char>& getLodLevels() const { return lodLevels; }
 
     bool isRefractive = false;
+    // flip texture rows on decode, for assets authored with a bottom left origin
+    bool flipTextures = false;
 
     std::vector<Mesh> meshes;
     std::vector<Texture> textures_loaded;
 
+    // world space bounds of all meshes
+    AABB bounds;
+
 private:
     // model data
     std::string directory;
     TexturePackingCombination texture_packing_combination = TexturePackingCombination::NONE;
+    AABBList meshBounds;
+    std::vector<AABB> meshWorldBounds;
+    std::vector<unsigned char> lodLevels;
+
+    // reused by every draw
+    std::vector<DrawElementsIndirectCommand> drawCommands;
+
+    // index of every path in textures_loaded
+    std::unordered_map<std::string, size_t> textureIndices;
+
+    // pixels of textures_loaded[i] between decodeTexture() and its upload
+    struct DecodedImage {
+        unsigned char* data = nullptr;
+        // set instead of data when the texture cooker made a compressed version
+        CompressedImage compressed;
+        // no levels when decoding failed
+        UploadImage layout;
+        // copy of the pixels in the upload ring when there was room, data and compressed are freed then
+        TextureUploader::Allocation staged;
+    };
+    std::vector<DecodedImage> decodedImages;
+    size_t uploadedTextures = 0;
+    // the texture of textures_loaded[uploadedTextures] while it is uploaded over several steps
+    TextureUpload textureUpload;
+    unsigned int uploadingTexture = 0;
+    size_t uploadedMeshes = 0;
+    // open while the meshes of a cache hit are uploaded
+    MeshCache meshCache;
 
-    void loadModel(std::string path);
+    unsigned int getLod(size_t mesh) const { return mesh < lodLevels.size() ? lodLevels[mesh] : 0; }
     void processNode(aiNode* node, const aiScene* scene);
     Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+    std::string getTextureKey(size_t index) const;
+    // vertex cache statistics of the import order against the optimized one, see optimizeMesh()
+    void logOptimizeStats(const std::string& path, bool cached) const;
     std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type,
         std::string typeName);
 };
@@ -0,0 +1,106 @@
+#include "point_shadow_renderer.h"
+
+#include <cstring>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+static constexpr UniformId MODEL("model");
+static constexpr UniformId LIGHT_SPACE_MATRIX("lightSpaceMatrix");
+static constexpr UniformId LIGHT_POS("lightPos");
+static constexpr UniformId FAR_PLANE("far_plane");
+static constexpr UniformId TILE_OFFSET("tileOffset");
+
+static bool hasExtension(const char* name)
+{
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count; i++) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && std::strcmp(extension, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+PointShadowRenderer::PointShadowRenderer()
+    : geometryShader("point_shadow_map.vert", "point_shadow_map.frag", "point_shadow_map.geom")
+    , faceShader("point_shadow_map_face.vert", "point_shadow_map.frag")
+{
+    if (hasExtension("GL_ARB_shader_viewport_layer_array") || hasExtension("GL_AMD_vertex_shader_viewport_index")) {
+        instancedShader = std::make_unique<Shader>("point_shadow_map_instanced.vert", "point_shadow_map.frag");
+    }
+}
+
+bool PointShadowRenderer::isSupported(PointShadowMode mode) const
+{
+    return mode != PointShadowMode::VERTEX_VIEWPORT || instancedShader != nullptr;
+}
+
+CullStats PointShadowRenderer::render(PointShadowMode mode, const std::vector<Model*>& models, const std::vector<std::vector<unsigned char>>& visibility, const PointShadowView& light)
+{
+    if (!isSupported(mode)) {
+        mode = PointShadowMode::PER_FACE;
+    }
+
+    for (int face = 0; face < 6; face++) {
+        const glm::uvec4& rect = light.rects[face];
+        glScissor(rect.x, rect.y, rect.z, rect.w);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    CullStats stats;
+
+    if (mode == PointShadowMode::PER_FACE) {
+        faceShader.use();
+        faceShader.setVec3(LIGHT_POS, light.position);
+        faceShader.setFloat(FAR_PLANE, light.range);
+
+        for (int face = 0; face < 6; face++) {
+            const glm::uvec4& rect = light.rects[face];
+            const glm::mat4& lightSpaceMatrix = light.tiles[face].lightSpaceMatrix;
+            glViewport(rect.x, rect.y, rect.z, rect.w);
+            glScissor(rect.x, rect.y, rect.z, rect.w);
+            faceShader.setMat4(LIGHT_SPACE_MATRIX, lightSpaceMatrix);
+
+            Frustum faceFrustum = Frustum::fromMatrix(lightSpaceMatrix);
+            for (size_t m = 0; m < models.size(); m++) {
+                models[m]->cull(faceFrustum, faceVisibility, stats);
+                faceShader.setMat4(MODEL, models[m]->transform.modelMatrix);
+                models[m]->DrawDepth(faceVisibility);
+            }
+        }
+        return stats;
+    }
+
+    // both single pass paths route every face to its own viewport, each with its own scissor since glScissor
+    // above set all of them to the last face
+    for (int face = 0; face < 6; face++) {
+        const glm::uvec4& rect = light.rects[face];
+        glViewportIndexedf(face, static_cast<float>(rect.x), static_cast<float>(rect.y), static_cast<float>(rect.z), static_cast<float>(rect.w));
+        glScissorIndexed(face, rect.x, rect.y, rect.z, rect.w);
+    }
+
+    Shader& shader = mode == PointShadowMode::GEOMETRY_SHADER ? geometryShader : *instancedShader;
+    int instanceCount = mode == PointShadowMode::VERTEX_VIEWPORT ? 6 : 1;
+
+    shader.use();
+    shader.setInt(TILE_OFFSET, light.firstTile);
+    shader.setVec3(LIGHT_POS, light.position);
+    shader.setFloat(FAR_PLANE, light.range);
+
+    for (size_t m = 0; m < models.size(); m++) {
+        for (unsigned char visible : visibility[m]) {
+            stats.drawn += visible * 6;
+            stats.culled += (1 - visible) * 6;
+        }
+        shader.setMat4(MODEL, models[m]->transform.modelMatrix);
+        models[m]->DrawDepth(visibility[m], instanceCount);
+    }
+    return stats;
+}
+
+Frustum PointShadowRenderer::getCubeFrustum(const glm::vec3& position, float range)
+{
+    return Frustum::fromMatrix(glm::ortho(-range, range, -range, range, -range, range) * glm::translate(glm::mat4(1.0f), -position));
+}
@@ -0,0 +1,57 @@
+#ifndef POINT_SHADOW_RENDERER_H
+#define POINT_SHADOW_RENDERER_H
+
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "culling.h"
+#include "frame_data.h"
+#include "model.h"
+#include "shader.h"
+
+enum class PointShadowMode {
+    // every triangle is fanned out to all six faces in a geometry shader
+    GEOMETRY_SHADER = 0,
+    // six instances per draw, the vertex shader picks the face viewport
+    VERTEX_VIEWPORT = 1,
+    // one draw per face, with the casters culled against every face
+    PER_FACE = 2,
+};
+
+// The six atlas tiles of one point light, tiles and rects point at its first face.
+struct PointShadowView {
+    glm::vec3 position;
+    float range;
+    int firstTile;
+    const ShadowTileData* tiles;
+    const glm::uvec4* rects;
+};
+
+// Renders point light shadows into their atlas tiles with one of the PointShadowMode paths.
+// VERTEX_VIEWPORT needs GL_ARB_shader_viewport_layer_array or GL_AMD_vertex_shader_viewport_index.
+class PointShadowRenderer {
+public:
+    PointShadowRenderer();
+
+    bool isSupported(PointShadowMode mode) const;
+
+    // Clears and renders the light's faces, unsupported modes fall back to PER_FACE. Expects the atlas attached to the
+    // bound framebuffer, the scissor test enabled and the shadow tile buffer bound. visibility holds the casters
+    // culled against the whole cube around the light. Returns the meshes drawn over all faces.
+    CullStats render(PointShadowMode mode, const std::vector<Model*>& models, const std::vector<std::vector<unsigned char>>& visibility, const PointShadowView& light);
+
+    // box around the light that contains all six face frustums
+    static Frustum getCubeFrustum(const glm::vec3& position, float range);
+
+private:
+    Shader geometryShader;
+    Shader faceShader;
+    // only created if the vertex shader can write gl_ViewportIndex
+    std::unique_ptr<Shader> instancedShader;
+
+    std::vector<unsigned char> faceVisibility;
+};
+
+#endif
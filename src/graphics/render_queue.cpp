@@ -0,0 +1,122 @@
+#include "render_queue.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "geometry_pool.h"
+
+static constexpr UniformId MODEL("model");
+static constexpr UniformId IS_REFRACTIVE("isRefractive");
+
+bool RenderQueue::sortingEnabled = true;
+
+uint64_t RenderQueue::makeKey(RenderPass pass, unsigned int program, float depth, unsigned int material)
+{
+    // non negative floats order like their bits
+    depth = std::max(depth, 0.0f);
+    uint32_t depthBits;
+    std::memcpy(&depthBits, &depth, sizeof(depthBits));
+
+    // program and material ids are truncated, a collision only costs a state change
+    return (static_cast<uint64_t>(pass) & 0xf) << 60
+        | (static_cast<uint64_t>(program) & 0xff) << 52
+        | static_cast<uint64_t>(depthBits) << 20
+        | (static_cast<uint64_t>(material) & 0xfffff);
+}
+
+void RenderQueue::execute()
+{
+    if (packets.empty())
+        return;
+
+    stats.packets += static_cast<unsigned int>(packets.size());
+    order.resize(packets.size());
+    for (size_t i = 0; i < packets.size(); i++) {
+        order[i] = { packets[i].key, static_cast<unsigned int>(i) };
+    }
+    if (sortingEnabled)
+        radixSort();
+
+    // state set by the previous packet, the uniforms belong to the current program
+    Shader* shader = nullptr;
+    const glm::mat4* modelMatrix = nullptr;
+    int isRefractive = -1;
+
+    for (const SortEntry& entry : order) {
+        const DrawPacket& packet = packets[entry.packet];
+
+        if (packet.shader != shader) {
+            flushBatch();
+            shader = packet.shader;
+            shader->use();
+            modelMatrix = nullptr;
+            isRefractive = -1;
+            stats.programChanges++;
+        }
+
+        if (packet.modelMatrix != modelMatrix) {
+            flushBatch();
+            modelMatrix = packet.modelMatrix;
+            shader->setMat4(MODEL, *modelMatrix);
+            stats.uniformChanges++;
+        }
+
+        if (static_cast<int>(packet.isRefractive) != isRefractive) {
+            flushBatch();
+            isRefractive = packet.isRefractive;
+            shader->setBool(IS_REFRACTIVE, packet.isRefractive);
+            stats.uniformChanges++;
+        }
+
+        if (packet.mesh->pooled && GeometryPool::multiDrawEnabled) {
+            batch.push_back(packet.mesh->getDrawCommand(packet.lod, packet.instanceCount));
+        } else {
+            flushBatch();
+            packet.mesh->drawGeometry(packet.lod, packet.instanceCount);
+            stats.drawCalls++;
+        }
+    }
+    flushBatch();
+
+    packets.clear();
+}
+
+void RenderQueue::radixSort()
+{
+    size_t counts[8][256] = {};
+    for (const SortEntry& entry : order) {
+        for (int digit = 0; digit < 8; digit++) {
+            counts[digit][(entry.key >> (digit * 8)) & 0xff]++;
+        }
+    }
+
+    scratch.resize(order.size());
+    for (int digit = 0; digit < 8; digit++) {
+        int shift = digit * 8;
+        size_t* offsets = counts[digit];
+        // e.g. the pass and program of a queue holding one of each
+        if (offsets[(order[0].key >> shift) & 0xff] == order.size())
+            continue;
+
+        size_t offset = 0;
+        for (int bucket = 0; bucket < 256; bucket++) {
+            size_t count = offsets[bucket];
+            offsets[bucket] = offset;
+            offset += count;
+        }
+        for (const SortEntry& entry : order) {
+            scratch[offsets[(entry.key >> shift) & 0xff]++] = entry;
+        }
+        order.swap(scratch);
+    }
+}
+
+void RenderQueue::flushBatch()
+{
+    if (batch.empty())
+        return;
+
+    GeometryPool::get().multiDraw(batch);
+    stats.drawCalls++;
+    batch.clear();
+}
@@ -0,0 +1,78 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "shader.h"
+
+// Passes in the order they are executed, the top bits of a sort key.
+enum class RenderPass : uint8_t {
+    SHADOW = 0,
+    LIGHTING = 1,
+};
+
+// Everything one mesh draw needs. The key only decides the order, state is compared by the fields below.
+struct DrawPacket {
+    uint64_t key;
+    Shader* shader;
+    const Mesh* mesh;
+    // owned by the submitting entity, compared by address
+    const glm::mat4* modelMatrix;
+    unsigned int lod;
+    int instanceCount;
+    bool isRefractive;
+};
+
+// Draws of a pass collected from the scene and executed sorted by a 64 bit key:
+//   pass (4 bits) | program (8 bits) | depth (32 bits) | material (20 bits)
+// so each program is bound once and opaque draws go front to back. Materials need no binding (MaterialSystem),
+// they only order the meshes of a model, which keeps the model's packets together.
+// Execution only issues the state that changed since the previous packet, and consecutive pooled meshes with the
+// same state become one multi draw. The GL state the queue tracks is unknown when execute() starts.
+class RenderQueue {
+public:
+    // per frame, see resetFrameStats()
+    struct Stats {
+        unsigned int packets = 0;
+        unsigned int programChanges = 0;
+        // model matrix and per model uniforms
+        unsigned int uniformChanges = 0;
+        unsigned int drawCalls = 0;
+    };
+
+    static uint64_t makeKey(RenderPass pass, unsigned int program, float depth, unsigned int material);
+
+    void submit(const DrawPacket& packet) { packets.push_back(packet); }
+    // sorts and draws the packets submitted since the last call, then clears them
+    void execute();
+
+    Stats getStats() const { return stats; }
+    void resetFrameStats() { stats = Stats(); }
+
+    // off executes packets in submission order, to compare the state changes
+    static bool sortingEnabled;
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        unsigned int packet;
+    };
+
+    std::vector<DrawPacket> packets;
+    std::vector<SortEntry> order;
+    std::vector<SortEntry> scratch;
+    // pooled meshes waiting for one multi draw with the current state
+    std::vector<DrawElementsIndirectCommand> batch;
+
+    Stats stats;
+
+    // least significant digit first, 8 bits at a time. Stable, digits all keys share are skipped.
+    void radixSort();
+    void flushBatch();
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "render_target_pool.h"
+
+static size_t bytesPerPixel(GLenum internalFormat)
+{
+    switch (internalFormat) {
+    case GL_RED:
+    case GL_R8:
+        return 1;
+    case GL_RG:
+    case GL_RG8:
+        return 2;
+    case GL_RGB:
+    case GL_RGB8:
+        return 3;
+    case GL_RGB16F:
+        return 6;
+    case GL_RGBA16F:
+        return 8;
+    case GL_RGBA32F:
+        return 16;
+    default:
+        return 4;
+    }
+}
+
+void RenderTargetPool::clear()
+{
+    for (auto& entry : entries) {
+        release(entry);
+    }
+    entries.clear();
+}
+
+void RenderTargetPool::beginFrame()
+{
+    frameIndex++;
+
+    stats.allocations = 0;
+    stats.reuses = 0;
+    stats.releases = 0;
+
+    for (auto& entry : entries) {
+        entry.inUse = false;
+    }
+}
+
+void RenderTargetPool::endFrame()
+{
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (frameIndex - it->lastUsedFrame > maxIdleFrames) {
+            release(*it);
+            stats.releases++;
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    stats.residentTargets = static_cast<unsigned int>(entries.size());
+    stats.residentBytes = 0;
+    for (auto& entry : entries) {
+        stats.residentBytes += entry.bytes;
+    }
+}
+
+unsigned int RenderTargetPool::acquireTexture(int width, int height, GLenum internalFormat, GLenum format, GLenum type)
+{
+    RenderTargetDesc desc = { width, height, internalFormat, false };
+    if (Entry* entry = findFree(desc)) {
+        return entry->id;
+    }
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    entries.push_back({ desc, texture, width * height * bytesPerPixel(internalFormat), true, frameIndex });
+    stats.allocations++;
+
+    return texture;
+}
+
+unsigned int RenderTargetPool::acquireRenderbuffer(int width, int height, GLenum internalFormat)
+{
+    RenderTargetDesc desc = { width, height, internalFormat, true };
+    if (Entry* entry = findFree(desc)) {
+        return entry->id;
+    }
+
+    unsigned int rbo;
+    glGenRenderbuffers(1, &rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, internalFormat, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    entries.push_back({ desc, rbo, width * height * bytesPerPixel(internalFormat), true, frameIndex });
+    stats.allocations++;
+
+    return rbo;
+}
+
+RenderTargetPool::Entry* RenderTargetPool::findFree(const RenderTargetDesc& desc)
+{
+    for (auto& entry : entries) {
+        if (!entry.inUse && entry.desc == desc) {
+            entry.inUse = true;
+            entry.lastUsedFrame = frameIndex;
+            stats.reuses++;
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void RenderTargetPool::release(const Entry& entry)
+{
+    if (entry.desc.isRenderbuffer) {
+        glDeleteRenderbuffers(1, &entry.id);
+    } else {
+        glDeleteTextures(1, &entry.id);
+    }
+}
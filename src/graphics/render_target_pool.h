@@ -0,0 +1,66 @@
+#ifndef RENDER_TARGET_POOL_H
+#define RENDER_TARGET_POOL_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// Description of a render target attachment. Targets are recycled only when all of these match.
+struct RenderTargetDesc {
+    int width;
+    int height;
+    GLenum internalFormat;
+    bool isRenderbuffer;
+
+    bool operator==(const RenderTargetDesc& other) const
+    {
+        return width == other.width && height == other.height && internalFormat == other.internalFormat && isRenderbuffer == other.isRenderbuffer;
+    }
+};
+
+// Keeps framebuffer attachments alive across frames and hands them out again when a matching
+// size/format is requested, so GPU memory is only reallocated when the viewport actually changes.
+class RenderTargetPool {
+public:
+    struct FrameStats {
+        unsigned int allocations = 0;
+        unsigned int reuses = 0;
+        unsigned int releases = 0;
+        unsigned int residentTargets = 0;
+        size_t residentBytes = 0;
+    };
+
+    // targets that weren't acquired for this many frames get deleted
+    unsigned int maxIdleFrames = 2;
+
+    // resets per-frame counters and marks every pooled target as free to be acquired again
+    void beginFrame();
+    // deletes targets that have been idle for more than maxIdleFrames, call after the frame was submitted
+    void endFrame();
+
+    // deletes every pooled target, needs a current GL context
+    void clear();
+
+    unsigned int acquireTexture(int width, int height, GLenum internalFormat, GLenum format, GLenum type);
+    unsigned int acquireRenderbuffer(int width, int height, GLenum internalFormat);
+
+    const FrameStats& getFrameStats() const { return stats; }
+
+private:
+    struct Entry {
+        RenderTargetDesc desc;
+        unsigned int id;
+        size_t bytes;
+        bool inUse;
+        unsigned int lastUsedFrame;
+    };
+
+    std::vector<Entry> entries;
+    unsigned int frameIndex = 0;
+    FrameStats stats;
+
+    Entry* findFree(const RenderTargetDesc& desc);
+    void release(const Entry& entry);
+};
+
+#endif
@@ -1,8 +1,28 @@
 #include "shader.h"
 
+#include <algorithm>
+
 #include <spdlog/spdlog.h>
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
+static void insertDefines(std::string& code, const std::vector<std::string>& defines)
+{
+    if (defines.empty())
+        return;
+
+    std::string lines;
+    for (const std::string& define : defines)
+        lines += "#define " + define + "\n";
+    // #version has to stay the first line
+    size_t position = 0;
+    size_t version = code.find("#version");
+    if (version != std::string::npos) {
+        size_t end = code.find('\n', version);
+        position = end == std::string::npos ? code.size() : end + 1;
+    }
+    code.insert(position, lines);
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath, const std::vector<std::string>& defines)
 {
     // 1. retrieve the vertex/fragment source code from filePath
     std::string vertexCode;
@@ -41,6 +61,10 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geo
     } catch (std::ifstream::failure e) {
         spdlog::error("SHADER::FILE_NOT_SUCCESFULLY_READ");
     }
+    insertDefines(vertexCode, defines);
+    insertDefines(fragmentCode, defines);
+    if (geometryPath != nullptr)
+        insertDefines(geometryCode, defines);
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
     // 2. compile shaders
@@ -91,6 +115,124 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geo
     glDeleteShader(fragment);
     if (geometryPath != nullptr)
         glDeleteShader(geometry);
+
+    reflectUniforms();
+}
+
+Shader::Shader(const char* computePath)
+{
+    std::string computeCode;
+    std::ifstream cShaderFile;
+    cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    try {
+        cShaderFile.open("resources/shaders/" + std::string(computePath));
+        std::stringstream cShaderStream;
+        cShaderStream << cShaderFile.rdbuf();
+        cShaderFile.close();
+        computeCode = cShaderStream.str();
+    } catch (std::ifstream::failure& e) {
+        spdlog::error("SHADER::FILE_NOT_SUCCESFULLY_READ");
+    }
+    const char* cShaderCode = computeCode.c_str();
+
+    unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(compute, 1, &cShaderCode, NULL);
+    glCompileShader(compute);
+    checkCompileErrors(compute, "COMPUTE");
+
+    ID = glCreateProgram();
+    glAttachShader(ID, compute);
+    glLinkProgram(ID);
+
+    int success;
+    char infoLog[512];
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(ID, 512, NULL, infoLog);
+        spdlog::error("SHADER::PROGRAM::LINKING_FAILED {}", infoLog);
+    }
+
+    glDeleteShader(compute);
+
+    reflectUniforms();
+}
+
+void Shader::reflectUniforms()
+{
+    int uniformCount = 0;
+    int maxNameLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    // gather first, arrays expand into one entry per element
+    std::vector<std::pair<std::string, int>> uniforms;
+    std::vector<char> nameBuffer(std::max(maxNameLength, 1));
+    for (int i = 0; i < uniformCount; i++) {
+        int length = 0, size = 0;
+        GLenum type;
+        glGetActiveUniform(ID, i, static_cast<GLsizei>(nameBuffer.size()), &length, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), length);
+
+        // members of uniform blocks have no location
+        int location = glGetUniformLocation(ID, name.c_str());
+        if (location < 0) {
+            continue;
+        }
+
+        uniforms.push_back({ name, location });
+
+        // "name[0]" can also be set as "name", and every other element is looked up as "name[i]"
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            std::string baseName = name.substr(0, name.size() - 3);
+            uniforms.push_back({ baseName, location });
+            for (int element = 1; element < size; element++) {
+                std::string elementName = baseName + "[" + std::to_string(element) + "]";
+                uniforms.push_back({ elementName, glGetUniformLocation(ID, elementName.c_str()) });
+            }
+        }
+    }
+
+    size_t capacity = 16;
+    while (capacity < uniforms.size() * 2) {
+        capacity *= 2;
+    }
+    uniformTable.assign(capacity, { 0, -1 });
+    uniformTableMask = capacity - 1;
+
+    for (const auto& uniform : uniforms) {
+        insertUniform(uniform.first, uniform.second);
+    }
+}
+
+void Shader::insertUniform(const std::string& name, int location)
+{
+    if (location < 0) {
+        return;
+    }
+
+    uint64_t hash = UniformId::fnv1a(name.c_str());
+    size_t slot = hash & uniformTableMask;
+    while (uniformTable[slot].location >= 0 && uniformTable[slot].hash != hash) {
+        slot = (slot + 1) & uniformTableMask;
+    }
+    uniformTable[slot] = { hash, location };
+}
+
+int Shader::getUniformLocation(UniformId id) const
+{
+    if (uniformTable.empty()) {
+        return -1;
+    }
+
+    // linear probing, the table is never more than half full so an empty slot always ends the search
+    size_t slot = id.hash & uniformTableMask;
+    while (uniformTable[slot].location >= 0) {
+        if (uniformTable[slot].hash == id.hash) {
+            return uniformTable[slot].location;
+        }
+        slot = (slot + 1) & uniformTableMask;
+    }
+    return -1;
 }
 
 void Shader::use()
@@ -98,61 +240,61 @@ void Shader::use()
     glUseProgram(ID);
 }
 
-void Shader::setBool(const std::string& name, bool value) const
+void Shader::setBool(UniformId id, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(getUniformLocation(id), (int)value);
 }
 // ------------------------------------------------------------------------
-void Shader::setInt(const std::string& name, int value) const
+void Shader::setInt(UniformId id, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(getUniformLocation(id), value);
 }
 // ------------------------------------------------------------------------
-void Shader::setFloat(const std::string& name, float value) const
+void Shader::setFloat(UniformId id, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(getUniformLocation(id), value);
 }
 // ------------------------------------------------------------------------
-void Shader::setVec2(const std::string& name, const glm::vec2& value) const
+void Shader::setVec2(UniformId id, const glm::vec2& value) const
 {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform2fv(getUniformLocation(id), 1, &value[0]);
 }
-void Shader::setVec2(const std::string& name, float x, float y) const
+void Shader::setVec2(UniformId id, float x, float y) const
 {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+    glUniform2f(getUniformLocation(id), x, y);
 }
 // ------------------------------------------------------------------------
-void Shader::setVec3(const std::string& name, const glm::vec3& value) const
+void Shader::setVec3(UniformId id, const glm::vec3& value) const
 {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform3fv(getUniformLocation(id), 1, &value[0]);
 }
-void Shader::setVec3(const std::string& name, float x, float y, float z) const
+void Shader::setVec3(UniformId id, float x, float y, float z) const
 {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    glUniform3f(getUniformLocation(id), x, y, z);
 }
 // ------------------------------------------------------------------------
-void Shader::setVec4(const std::string& name, const glm::vec4& value) const
+void Shader::setVec4(UniformId id, const glm::vec4& value) const
 {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform4fv(getUniformLocation(id), 1, &value[0]);
 }
-void Shader::setVec4(const std::string& name, float x, float y, float z, float w) const
+void Shader::setVec4(UniformId id, float x, float y, float z, float w) const
 {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+    glUniform4f(getUniformLocation(id), x, y, z, w);
 }
 // ------------------------------------------------------------------------
-void Shader::setMat2(const std::string& name, const glm::mat2& mat) const
+void Shader::setMat2(UniformId id, const glm::mat2& mat) const
 {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix2fv(getUniformLocation(id), 1, GL_FALSE, &mat[0][0]);
 }
 // ------------------------------------------------------------------------
-void Shader::setMat3(const std::string& name, const glm::mat3& mat) const
+void Shader::setMat3(UniformId id, const glm::mat3& mat) const
 {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix3fv(getUniformLocation(id), 1, GL_FALSE, &mat[0][0]);
 }
 // ------------------------------------------------------------------------
-void Shader::setMat4(const std::string& name, const glm::mat4& mat) const
+void Shader::setMat4(UniformId id, const glm::mat4& mat) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix4fv(getUniformLocation(id), 1, GL_FALSE, &mat[0][0]);
 }
 
 void Shader::checkCompileErrors(GLuint shader, std::string type)
@@ -5,36 +5,77 @@
 
 #include <glm/glm.hpp>
 
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
+
+// 64-bit FNV-1a hash of a uniform name. Literals hash at compile time when the id is constexpr,
+// e.g. static constexpr UniformId MODEL("model"), so setters never build or hash strings at draw time.
+struct UniformId {
+    uint64_t hash;
+
+    constexpr UniformId(const char* name)
+        : hash(fnv1a(name))
+    {
+    }
+    UniformId(const std::string& name)
+        : hash(fnv1a(name.c_str()))
+    {
+    }
+
+    static constexpr uint64_t fnv1a(const char* name)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        while (*name) {
+            hash ^= static_cast<unsigned char>(*name++);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+};
 
 class Shader {
 public:
     // the program ID
     unsigned int ID;
 
-    // constructor reads and builds the shader
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
+    // constructor reads and builds the shader, every define is added to each stage right after its #version line
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::vector<std::string>& defines = {});
+    // compute shader program
+    explicit Shader(const char* computePath);
     // use/activate the shader
     void use();
+    // location of an active uniform, looked up in the table reflected after linking; -1 if the uniform isn't active
+    int getUniformLocation(UniformId id) const;
     // utility uniform functions
-    void setBool(const std::string& name, bool value) const;
-    void setInt(const std::string& name, int value) const;
-    void setFloat(const std::string& name, float value) const;
-    void setVec2(const std::string& name, const glm::vec2& value) const;
-    void setVec2(const std::string& name, float x, float y) const;
-    void setVec3(const std::string& name, const glm::vec3& value) const;
-    void setVec3(const std::string& name, float x, float y, float z) const;
-    void setVec4(const std::string& name, const glm::vec4& value) const;
-    void setVec4(const std::string& name, float x, float y, float z, float w) const;
-    void setMat2(const std::string& name, const glm::mat2& mat) const;
-    void setMat3(const std::string& name, const glm::mat3& mat) const;
-    void setMat4(const std::string& name, const glm::mat4& mat) const;
+    void setBool(UniformId id, bool value) const;
+    void setInt(UniformId id, int value) const;
+    void setFloat(UniformId id, float value) const;
+    void setVec2(UniformId id, const glm::vec2& value) const;
+    void setVec2(UniformId id, float x, float y) const;
+    void setVec3(UniformId id, const glm::vec3& value) const;
+    void setVec3(UniformId id, float x, float y, float z) const;
+    void setVec4(UniformId id, const glm::vec4& value) const;
+    void setVec4(UniformId id, float x, float y, float z, float w) const;
+    void setMat2(UniformId id, const glm::mat2& mat) const;
+    void setMat3(UniformId id, const glm::mat3& mat) const;
+    void setMat4(UniformId id, const glm::mat4& mat) const;
 
 private:
+    // open addressing table of name hash -> location, sized to a power of two at least twice the uniform count
+    struct UniformSlot {
+        uint64_t hash;
+        int location;
+    };
+    std::vector<UniformSlot> uniformTable;
+    size_t uniformTableMask = 0;
+
     void checkCompileErrors(GLuint shader, std::string type);
+    void reflectUniforms();
+    void insertUniform(const std::string& name, int location);
 };
 
 #endif
@@ -0,0 +1,103 @@
+#include "shadow_atlas.h"
+
+#include <algorithm>
+
+ShadowAtlas::ShadowAtlas(unsigned int size, unsigned int minTileSize, unsigned int maxTileSize)
+    : size(size)
+    , minTileSize(minTileSize)
+    , maxTileSize(std::min(maxTileSize, size))
+{
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    // samples are clamped to their tile in the shader, the texture edge is never reached
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    freeNodes.resize(getLevel(minTileSize) + 1);
+    reset();
+}
+
+void ShadowAtlas::reset()
+{
+    previousAllocations.swap(allocations);
+    allocations.clear();
+    usedArea = 0;
+
+    for (auto& nodes : freeNodes) {
+        nodes.clear();
+    }
+    freeNodes[0].push_back(glm::uvec2(0, 0));
+}
+
+bool ShadowAtlas::allocate(unsigned int tileSize, glm::uvec4& rect)
+{
+    tileSize = glm::clamp(tileSize, minTileSize, maxTileSize);
+    int targetLevel = static_cast<int>(getLevel(tileSize));
+
+    // smallest free node the tile fits into
+    int level = targetLevel;
+    while (level >= 0 && freeNodes[level].empty()) {
+        level--;
+    }
+    if (level < 0) {
+        return false;
+    }
+
+    glm::uvec2 node = freeNodes[level].back();
+    freeNodes[level].pop_back();
+
+    // split it down to the requested size, the other three quarters stay free. Pushed in reverse so tiles
+    // are handed out top left first and the same requests always produce the same layout.
+    while (level < targetLevel) {
+        level++;
+        unsigned int half = size >> level;
+        freeNodes[level].push_back(node + glm::uvec2(half, half));
+        freeNodes[level].push_back(node + glm::uvec2(0, half));
+        freeNodes[level].push_back(node + glm::uvec2(half, 0));
+    }
+
+    rect = glm::uvec4(node, tileSize, tileSize);
+    allocations.push_back(rect);
+    usedArea += static_cast<unsigned long long>(tileSize) * tileSize;
+    return true;
+}
+
+void ShadowAtlas::release(const glm::uvec4& rect)
+{
+    auto it = std::find(allocations.begin(), allocations.end(), rect);
+    if (it == allocations.end()) {
+        return;
+    }
+
+    allocations.erase(it);
+    usedArea -= static_cast<unsigned long long>(rect.z) * rect.w;
+    freeNodes[getLevel(rect.z)].push_back(glm::uvec2(rect.x, rect.y));
+}
+
+unsigned int ShadowAtlas::getTileSize(float coverage) const
+{
+    float target = coverage * maxTileSize;
+    unsigned int tileSize = maxTileSize;
+    while (tileSize > minTileSize && tileSize > target) {
+        tileSize >>= 1;
+    }
+    return tileSize;
+}
+
+glm::vec4 ShadowAtlas::getUVRect(const glm::uvec4& rect) const
+{
+    return glm::vec4(rect) / static_cast<float>(size);
+}
+
+unsigned int ShadowAtlas::getLevel(unsigned int tileSize) const
+{
+    unsigned int level = 0;
+    while ((size >> level) > tileSize) {
+        level++;
+    }
+    return level;
+}
@@ -0,0 +1,56 @@
+#ifndef SHADOW_ATLAS_H
+#define SHADOW_ATLAS_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Packs the shadow maps of spot lights and the six faces of point lights into one depth texture. Tiles are power of
+// two squares handed out by a quadtree (buddy) allocator, so differently sized tiles share a fixed memory budget.
+class ShadowAtlas {
+public:
+    // size and tile sizes must be powers of two
+    ShadowAtlas(unsigned int size, unsigned int minTileSize, unsigned int maxTileSize);
+
+    // frees every tile, the atlas is packed from scratch every frame
+    void reset();
+
+    // Finds a free tile of the given size. rect is x, y, width, height in texels. Returns false if the atlas is full.
+    // Allocating larger tiles first keeps the atlas free of fragmentation.
+    bool allocate(unsigned int tileSize, glm::uvec4& rect);
+    // returns a tile from this frame to the free list, e.g. when a point light didn't get all six faces
+    void release(const glm::uvec4& rect);
+
+    // largest power of two tile that isn't bigger than coverage (0 - 1) of the maximum tile size
+    unsigned int getTileSize(float coverage) const;
+    // tile rect as offset and scale in texture coordinates
+    glm::vec4 getUVRect(const glm::uvec4& rect) const;
+
+    // true if this frame's tiles differ from the previous frame's, tiles of cached shadows may have been overwritten
+    bool hasLayoutChanged() const { return allocations != previousAllocations; }
+
+    unsigned int getTexture() const { return texture; }
+    unsigned int getSize() const { return size; }
+    unsigned int getMinTileSize() const { return minTileSize; }
+    unsigned int getTileCount() const { return static_cast<unsigned int>(allocations.size()); }
+    // fraction of the atlas covered by tiles
+    float getUsage() const { return static_cast<float>(usedArea) / (static_cast<float>(size) * size); }
+
+private:
+    unsigned int getLevel(unsigned int tileSize) const;
+
+    unsigned int texture;
+    unsigned int size;
+    unsigned int minTileSize;
+    unsigned int maxTileSize;
+
+    // free tile origins per quadtree level, level 0 is the whole atlas
+    std::vector<std::vector<glm::uvec2>> freeNodes;
+    std::vector<glm::uvec4> allocations;
+    std::vector<glm::uvec4> previousAllocations;
+    unsigned long long usedArea = 0;
+};
+
+#endif
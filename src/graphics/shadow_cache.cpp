@@ -0,0 +1,35 @@
+#include "shadow_cache.h"
+
+void ShadowCache::Signature::add(const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+bool ShadowCache::needsUpdate(unsigned int layer, uint64_t signature)
+{
+    if (layer >= signatures.size()) {
+        signatures.resize(layer + 1, 0);
+        valid.resize(layer + 1, 0);
+    }
+
+    if (enabled && valid[layer] && signatures[layer] == signature) {
+        stats.cached++;
+        return false;
+    }
+
+    signatures[layer] = signature;
+    valid[layer] = enabled;
+    stats.rendered++;
+    return true;
+}
+
+void ShadowCache::invalidate(unsigned int firstLayer)
+{
+    for (size_t i = firstLayer; i < valid.size(); i++) {
+        valid[i] = 0;
+    }
+}
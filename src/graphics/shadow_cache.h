@@ -0,0 +1,46 @@
+#ifndef SHADOW_CACHE_H
+#define SHADOW_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Remembers what every shadow map layer was last rendered from. A layer whose light and visible casters did not
+// change keeps the depth of an earlier frame instead of being cleared and redrawn.
+class ShadowCache {
+public:
+    struct Stats {
+        unsigned int rendered = 0;
+        unsigned int cached = 0;
+    };
+
+    // FNV-1a over everything a layer's depth depends on: the light's matrices and the casters that survived culling
+    class Signature {
+    public:
+        void add(const void* data, size_t size);
+        template <typename T>
+        void add(const T& value) { add(&value, sizeof(T)); }
+
+        uint64_t get() const { return hash; }
+
+    private:
+        uint64_t hash = 14695981039346656037ull;
+    };
+
+    // returns true if the layer has to be redrawn, the signature is remembered for the next frames
+    bool needsUpdate(unsigned int layer, uint64_t signature);
+    // forces every layer from firstLayer on to be redrawn
+    void invalidate(unsigned int firstLayer = 0);
+
+    void resetStats() { stats = Stats(); }
+    const Stats& getStats() const { return stats; }
+
+    bool enabled = true;
+
+private:
+    std::vector<uint64_t> signatures;
+    std::vector<unsigned char> valid;
+    Stats stats;
+};
+
+#endif
@@ -1,6 +1,8 @@
 #include "skybox.h"
 
+#include "common.h"
 #include "shader.h"
+#include "texture_uploader.h"
 
 #include <glad/glad.h>
 
@@ -8,32 +10,193 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
 #include <stb_image.h>
 
 #include <stdio.h>
 
+#include "../utils/hash.h"
+#include "../utils/mapped_file.h"
+
 void renderQuad();
 
+// bake settings, part of the cache key
+static constexpr int PREFILTER_SIZE = 128;
+// has to match prefilter.comp
+static constexpr int PREFILTER_LEVELS = 5;
+// samples per texel, filtered importance sampling needs far fewer than point sampling the base level
+static constexpr int PREFILTER_SAMPLES = 64;
+static constexpr int BRDF_LUT_SIZE = 512;
+
+// bump whenever the layout or the bake changes
+static constexpr uint32_t IBL_CACHE_MAGIC = 0x434c4249; // "IBLC"
+static constexpr uint32_t IBL_CACHE_VERSION = 3;
+static constexpr const char* IBL_CACHE_DIRECTORY = "cache";
+
+// followed by the irradiance coefficients, then the half float texels of the environment cubemap, every prefilter
+// level (faces in GL order, rows bottom up as glGetTexImage returns them) and the RG BRDF LUT
+struct IBLCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t cubemapSize;
+    uint32_t prefilterSize;
+    uint32_t prefilterLevels;
+    uint32_t brdfLUTSize;
+};
+
+static std::string getIBLCachePath(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.ibl", static_cast<unsigned long long>(key));
+    return std::string(IBL_CACHE_DIRECTORY) + '/' + name;
+}
+
+static int getMipCount(int size)
+{
+    return static_cast<int>(std::log2(size)) + 1;
+}
+
+// half float RGB texels of one face, or RG for the LUT
+static size_t getFaceBytes(int size, int components)
+{
+    return static_cast<size_t>(size) * size * components * sizeof(uint16_t);
+}
+
+static size_t getIBLCacheSize(const IBLCacheHeader& header)
+{
+    size_t size = sizeof(IBLCacheHeader) + sizeof(IrradianceData);
+    size += 6 * getFaceBytes(header.cubemapSize, 3);
+    for (uint32_t level = 0; level < header.prefilterLevels; level++)
+        size += 6 * getFaceBytes(std::max(header.prefilterSize >> level, 1u), 3);
+    size += getFaceBytes(header.brdfLUTSize, 2);
+    return size;
+}
+
+static constexpr float PI = 3.14159265359f;
+
+// Projects an equirectangular environment (rows bottom up, as uploaded) onto the nine L2 spherical harmonics and
+// convolves them with the clamped cosine lobe. The coefficients are scaled by the basis constants and 1 / PI, so
+// the shaders get the irradiance the old convolution map stored from the polynomials alone.
+static IrradianceData projectIrradiance(const float* pixels, int width, int height, int components)
+{
+    // the longitude terms are the same in every row
+    std::vector<float> cosLongitude(width), sinLongitude(width);
+    for (int x = 0; x < width; x++) {
+        float longitude = ((x + 0.5f) / width - 0.5f) * 2.0f * PI;
+        cosLongitude[x] = std::cos(longitude);
+        sinLongitude[x] = std::sin(longitude);
+    }
+
+    // bands of rows are summed on their own threads, then reduced
+    unsigned int threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<std::array<double, 27>> partialSums(threadCount);
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < threadCount; t++) {
+        threads.emplace_back([&, t]() {
+            double sums[27] = {};
+            for (int y = height * t / threadCount; y < height * (t + 1) / threadCount; y++) {
+                float latitude = ((y + 0.5f) / height - 0.5f) * PI;
+                float cosLatitude = std::cos(latitude);
+                float dirY = std::sin(latitude);
+                float solidAngle = cosLatitude * (2.0f * PI / width) * (PI / height);
+
+                float rowSums[27] = {};
+                const float* row = pixels + static_cast<size_t>(y) * width * components;
+                for (int x = 0; x < width; x++) {
+                    // same mapping as equirectangular_to_cubemap.frag
+                    float dirX = cosLatitude * cosLongitude[x];
+                    float dirZ = cosLatitude * sinLongitude[x];
+                    float basis[9] = {
+                        1.0f,
+                        dirY,
+                        dirZ,
+                        dirX,
+                        dirX * dirY,
+                        dirY * dirZ,
+                        3.0f * dirZ * dirZ - 1.0f,
+                        dirX * dirZ,
+                        dirX * dirX - dirY * dirY,
+                    };
+                    const float* texel = row + static_cast<size_t>(x) * components;
+                    for (int i = 0; i < 9; i++) {
+                        rowSums[i * 3 + 0] += texel[0] * basis[i];
+                        rowSums[i * 3 + 1] += texel[1] * basis[i];
+                        rowSums[i * 3 + 2] += texel[2] * basis[i];
+                    }
+                }
+                for (int i = 0; i < 27; i++)
+                    sums[i] += rowSums[i] * solidAngle;
+            }
+            std::copy(sums, sums + 27, partialSums[t].begin());
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    // squared basis constants (one for the projection, one for the evaluation), times the cosine lobe band
+    // factors 1, 2 / 3 and 1 / 4 of the irradiance divided by PI
+    const float scales[9] = {
+        0.282095f * 0.282095f,
+        0.488603f * 0.488603f * 2.0f / 3.0f,
+        0.488603f * 0.488603f * 2.0f / 3.0f,
+        0.488603f * 0.488603f * 2.0f / 3.0f,
+        1.092548f * 1.092548f / 4.0f,
+        1.092548f * 1.092548f / 4.0f,
+        0.315392f * 0.315392f / 4.0f,
+        1.092548f * 1.092548f / 4.0f,
+        0.546274f * 0.546274f / 4.0f,
+    };
+
+    IrradianceData irradiance = {};
+    for (int i = 0; i < 9; i++) {
+        for (int c = 0; c < 3; c++) {
+            double sum = 0.0;
+            for (const auto& partial : partialSums)
+                sum += partial[i * 3 + c];
+            irradiance.coefficients[i][c] = static_cast<float>(sum) * scales[i];
+        }
+    }
+    return irradiance;
+}
+
 Skybox::Skybox(const char* hdriPath)
+    : hdriPath(hdriPath)
 {
     // pbr: setup framebuffer
     // ----------------------
     glGenFramebuffers(1, &captureFBO);
     glGenRenderbuffers(1, &captureRBO);
+}
 
+void Skybox::loadHDR()
+{
     // pbr: load the HDR environment map
     // ---------------------------------
     int width, height, nrComponents;
-    float* data = stbi_loadf(hdriPath, &width, &height, &nrComponents, 0);
+    float* data = stbi_loadf(hdriPath.c_str(), &width, &height, &nrComponents, 0);
     if (data) {
-        glGenTextures(1, &hdrTexture);
-        glBindTexture(GL_TEXTURE_2D, hdrTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data); // note how we specify the texture's data value to be float
+        flipImageVertically(data, width, height, nrComponents * sizeof(float));
+        irradianceSH = projectIrradiance(data, width, height, nrComponents);
+        // note how we specify the texture's data value to be float
+        UploadImage image = UploadImage::fromPixels(width, height, nrComponents, GL_FLOAT, false);
+        hdrTexture = image.createTexture();
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        TextureUpload(hdrTexture, image, reinterpret_cast<const unsigned char*>(data), {}).finish();
 
         stbi_image_free(data);
     } else {
@@ -47,6 +210,13 @@ Skybox::~Skybox()
 
 void Skybox::generateCubemap(unsigned int cubemapSize)
 {
+    this->cubemapSize = cubemapSize;
+    cacheKey = computeCacheKey();
+    loadedFromCache = loadCache();
+    if (loadedFromCache)
+        return;
+    loadHDR();
+
     Shader equirectangularToCubemapShader("cubemap.vert", "equirectangular_to_cubemap.frag");
 
     glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
@@ -56,15 +226,14 @@ void Skybox::generateCubemap(unsigned int cubemapSize)
 
     // pbr: setup cubemap to render to and attach to framebuffer
     // ---------------------------------------------------------
+    // the prefilter samples its mips, see prefilter.frag
     glGenTextures(1, &envCubemap);
     glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
-    for (unsigned int i = 0; i < 6; ++i) {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, cubemapSize, cubemapSize, 0, GL_RGB, GL_FLOAT, nullptr);
-    }
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, getMipCount(cubemapSize), GL_RGB16F, cubemapSize, cubemapSize);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     // pbr: set up projection and view matrices for capturing data onto the 6 cubemap face directions
@@ -97,106 +266,30 @@ void Skybox::generateCubemap(unsigned int cubemapSize)
         renderCube();
     }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
-
-void Skybox::generateIrradianceMap()
-{
-    Shader prefilterShader("cubemap.vert", "prefilter.frag");
-    Shader irradianceShader("cubemap.vert", "irradiance_convolution.frag");
-    Shader brdfShader("brdf.vert", "brdf.frag");
-
-    // pbr: set up projection and view matrices for capturing data onto the 6 cubemap face directions
-    // ----------------------------------------------------------------------------------------------
-    glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-    glm::mat4 captureViews[] = {
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f))
-    };
 
-    // pbr: create an irradiance cubemap, and re-scale capture FBO to irradiance scale.
-    // --------------------------------------------------------------------------------
-    glGenTextures(1, &irradianceMap);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
-    for (unsigned int i = 0; i < 6; ++i) {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 32, 32, 0, GL_RGB, GL_FLOAT, nullptr);
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-    glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
-
-    // pbr: solve diffuse integral by convolution to create an irradiance (cube)map.
-    // -----------------------------------------------------------------------------
-    irradianceShader.use();
-    irradianceShader.setInt("environmentMap", 0);
-    irradianceShader.setMat4("projection", captureProjection);
-    glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+}
 
-    glViewport(0, 0, 32, 32); // don't forget to configure the viewport to the capture dimensions.
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-    for (unsigned int i = 0; i < 6; ++i) {
-        irradianceShader.setMat4("view", captureViews[i]);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, irradianceMap, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+void Skybox::generatePrefilterMap()
+{
+    if (loadedFromCache)
+        return;
 
-        renderCube();
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    Shader brdfShader("brdf.vert", "brdf.frag");
 
-    // pbr: create a pre-filter cubemap, and re-scale capture FBO to pre-filter scale.
-    // --------------------------------------------------------------------------------
+    // pbr: create a pre-filter cubemap, RGBA so the compute bake can write it as an image
+    // ------------------------------------------------------------------------------------
     glGenTextures(1, &prefilterMap);
     glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
-    for (unsigned int i = 0; i < 6; ++i) {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 128, 128, 0, GL_RGB, GL_FLOAT, nullptr);
-    }
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, PREFILTER_LEVELS, GL_RGBA16F, PREFILTER_SIZE, PREFILTER_SIZE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); // be sure to set minification filter to mip_linear
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // generate mipmaps for the cubemap so OpenGL automatically allocates the required memory.
-    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-
-    // pbr: run a quasi monte-carlo simulation on the environment lighting to create a prefilter (cube)map.
-    // ----------------------------------------------------------------------------------------------------
-    prefilterShader.use();
-    prefilterShader.setInt("environmentMap", 0);
-    prefilterShader.setMat4("projection", captureProjection);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-    unsigned int maxMipLevels = 5;
-    for (unsigned int mip = 0; mip < maxMipLevels; ++mip) {
-        // reisze framebuffer according to mip-level size.
-        unsigned int mipWidth = static_cast<unsigned int>(128 * std::pow(0.5, mip));
-        unsigned int mipHeight = static_cast<unsigned int>(128 * std::pow(0.5, mip));
-        glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipWidth, mipHeight);
-        glViewport(0, 0, mipWidth, mipHeight);
-
-        float roughness = (float)mip / (float)(maxMipLevels - 1);
-        prefilterShader.setFloat("roughness", roughness);
-        for (unsigned int i = 0; i < 6; ++i) {
-            prefilterShader.setMat4("view", captureViews[i]);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, prefilterMap, mip);
 
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            renderCube();
-        }
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    bakePrefilterMap();
 
     // pbr: generate a 2D LUT from the BRDF equations used.
     // ----------------------------------------------------
@@ -204,7 +297,7 @@ void Skybox::generateIrradianceMap()
 
     // pre-allocate enough memory for the LUT texture.
     glBindTexture(GL_TEXTURE_2D, brdfLUTTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, 512, 512, 0, GL_RG, GL_FLOAT, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, BRDF_LUT_SIZE, BRDF_LUT_SIZE, 0, GL_RG, GL_FLOAT, 0);
     // be sure to set wrapping mode to GL_CLAMP_TO_EDGE
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -214,15 +307,221 @@ void Skybox::generateIrradianceMap()
     // then re-configure capture framebuffer object and render screen-space quad with BRDF shader.
     glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
     glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, BRDF_LUT_SIZE, BRDF_LUT_SIZE);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, brdfLUTTexture, 0);
 
-    glViewport(0, 0, 512, 512);
+    glViewport(0, 0, BRDF_LUT_SIZE, BRDF_LUT_SIZE);
     brdfShader.use();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     renderQuad();
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    writeCache();
+}
+
+void Skybox::bakePrefilterMap()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
+
+    if (computePrefilter) {
+        Shader prefilterShader("prefilter.comp");
+        prefilterShader.use();
+        prefilterShader.setInt("environmentMap", 0);
+        prefilterShader.setFloat("resolution", static_cast<float>(cubemapSize));
+        prefilterShader.setInt("baseSize", PREFILTER_SIZE);
+        prefilterShader.setInt("sampleCount", PREFILTER_SAMPLES);
+
+        // image units 0 - 4 hold one level each
+        for (int level = 0; level < PREFILTER_LEVELS; level++)
+            glBindImageTexture(level, prefilterMap, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        unsigned int groups = (PREFILTER_SIZE + 7) / 8;
+        glDispatchCompute(groups, groups, 6 * PREFILTER_LEVELS);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+        for (int level = 0; level < PREFILTER_LEVELS; level++)
+            glBindImageTexture(level, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    } else {
+        Shader prefilterShader("cubemap.vert", "prefilter.frag");
+
+        // pbr: set up projection and view matrices for capturing data onto the 6 cubemap face directions
+        // ----------------------------------------------------------------------------------------------
+        glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
+        glm::mat4 captureViews[] = {
+            glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
+            glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
+            glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
+            glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)),
+            glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
+            glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f))
+        };
+
+        // pbr: run a quasi monte-carlo simulation on the environment lighting to create a prefilter (cube)map.
+        // ----------------------------------------------------------------------------------------------------
+        prefilterShader.use();
+        prefilterShader.setInt("environmentMap", 0);
+        prefilterShader.setMat4("projection", captureProjection);
+        prefilterShader.setFloat("resolution", static_cast<float>(cubemapSize));
+        prefilterShader.setInt("sampleCount", PREFILTER_SAMPLES);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+        for (int mip = 0; mip < PREFILTER_LEVELS; ++mip) {
+            // reisze framebuffer according to mip-level size.
+            int mipSize = std::max(PREFILTER_SIZE >> mip, 1);
+            glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipSize, mipSize);
+            glViewport(0, 0, mipSize, mipSize);
+
+            float roughness = (float)mip / (float)(PREFILTER_LEVELS - 1);
+            prefilterShader.setFloat("roughness", roughness);
+            prefilterShader.setFloat("outputSize", static_cast<float>(mipSize));
+            for (unsigned int i = 0; i < 6; ++i) {
+                prefilterShader.setMat4("view", captureViews[i]);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, prefilterMap, mip);
+
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                renderCube();
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // only measured for the stats, a bake is rare enough to wait for
+    glFinish();
+    prefilterBakeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+uint64_t Skybox::computeCacheKey() const
+{
+    const int settings[] = { static_cast<int>(cubemapSize), PREFILTER_SIZE, PREFILTER_LEVELS, PREFILTER_SAMPLES, BRDF_LUT_SIZE };
+
+    uint64_t hash = HASH_SEED;
+    hash = hashBytes(hash, &IBL_CACHE_VERSION, sizeof(IBL_CACHE_VERSION));
+    hash = hashBytes(hash, settings, sizeof(settings));
+    hash = hashFile(hash, hdriPath);
+    // the bake shaders decide the results as much as the settings
+    const char* shaders[] = { "cubemap.vert", "equirectangular_to_cubemap.frag", "prefilter.frag", "prefilter.comp", "brdf.vert", "brdf.frag" };
+    for (const char* shader : shaders)
+        hash = hashFile(hash, std::string("resources/shaders/") + shader);
+    return hash;
+}
+
+// storedLevels come from texels, the rest of the levels is generated
+static unsigned int createCubemap(GLenum internalFormat, int size, int levels, int storedLevels, const unsigned char*& texels)
+{
+    unsigned int cubemap;
+    glGenTextures(1, &cubemap);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, internalFormat, size, size);
+    for (int level = 0; level < storedLevels; level++) {
+        int levelSize = std::max(size >> level, 1);
+        for (unsigned int i = 0; i < 6; ++i) {
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, 0, 0, levelSize, levelSize, GL_RGB, GL_HALF_FLOAT, texels);
+            texels += getFaceBytes(levelSize, 3);
+        }
+    }
+    if (levels > storedLevels)
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return cubemap;
+}
+
+bool Skybox::loadCache()
+{
+    MappedFile file;
+    if (!file.open(getIBLCachePath(cacheKey)) || file.size() < sizeof(IBLCacheHeader))
+        return false;
+
+    const IBLCacheHeader& header = *reinterpret_cast<const IBLCacheHeader*>(file.data());
+    bool valid = header.magic == IBL_CACHE_MAGIC && header.version == IBL_CACHE_VERSION
+        && header.key == cacheKey && header.cubemapSize == cubemapSize && header.prefilterSize == PREFILTER_SIZE && header.prefilterLevels == PREFILTER_LEVELS && header.brdfLUTSize == BRDF_LUT_SIZE
+        && getIBLCacheSize(header) == file.size();
+    if (!valid)
+        return false;
+
+    // straight from the mapping, rows of three half floats aren't always four byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    std::memcpy(&irradianceSH, file.data() + sizeof(IBLCacheHeader), sizeof(IrradianceData));
+    const unsigned char* texels = file.data() + sizeof(IBLCacheHeader) + sizeof(IrradianceData);
+    envCubemap = createCubemap(GL_RGB16F, cubemapSize, getMipCount(cubemapSize), 1, texels);
+    prefilterMap = createCubemap(GL_RGBA16F, PREFILTER_SIZE, PREFILTER_LEVELS, PREFILTER_LEVELS, texels);
+
+    glGenTextures(1, &brdfLUTTexture);
+    glBindTexture(GL_TEXTURE_2D, brdfLUTTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG16F, BRDF_LUT_SIZE, BRDF_LUT_SIZE);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, BRDF_LUT_SIZE, BRDF_LUT_SIZE, GL_RG, GL_HALF_FLOAT, texels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    spdlog::info("Loaded IBL maps of {} from {}", hdriPath, getIBLCachePath(cacheKey));
+    return true;
+}
+
+void Skybox::writeCache()
+{
+    IBLCacheHeader header = {};
+    header.magic = IBL_CACHE_MAGIC;
+    header.version = IBL_CACHE_VERSION;
+    header.key = cacheKey;
+    header.cubemapSize = cubemapSize;
+    header.prefilterSize = PREFILTER_SIZE;
+    header.prefilterLevels = PREFILTER_LEVELS;
+    header.brdfLUTSize = BRDF_LUT_SIZE;
+
+    std::error_code error;
+    std::filesystem::create_directories(IBL_CACHE_DIRECTORY, error);
+
+    // written next to the entry and renamed, like the mesh cache
+    std::string path = getIBLCachePath(cacheKey);
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char*>(&irradianceSH), sizeof(irradianceSH));
+
+        // read back one face at a time, the environment faces alone are 24 MB each
+        std::vector<unsigned char> texels;
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        auto writeCubemap = [&](unsigned int cubemap, int size, int levels) {
+            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+            for (int level = 0; level < levels; level++) {
+                int levelSize = std::max(size >> level, 1);
+                texels.resize(getFaceBytes(levelSize, 3));
+                for (unsigned int i = 0; i < 6; ++i) {
+                    glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, GL_RGB, GL_HALF_FLOAT, texels.data());
+                    stream.write(reinterpret_cast<const char*>(texels.data()), texels.size());
+                }
+            }
+        };
+        writeCubemap(envCubemap, cubemapSize, 1);
+        writeCubemap(prefilterMap, PREFILTER_SIZE, PREFILTER_LEVELS);
+
+        texels.resize(getFaceBytes(BRDF_LUT_SIZE, 2));
+        glBindTexture(GL_TEXTURE_2D, brdfLUTTexture);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_HALF_FLOAT, texels.data());
+        stream.write(reinterpret_cast<const char*>(texels.data()), texels.size());
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+        if (!stream) {
+            spdlog::warn("Failed to write IBL cache {}", path);
+            stream.close();
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error)
+        std::filesystem::remove(temporaryPath, error);
 }
 
 // renderCube() renders a 1x1 3D cube in NDC.
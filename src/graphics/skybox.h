@@ -1,25 +1,52 @@
+#include <cstdint>
+#include <string>
+
+#include "frame_data.h"
+
 void renderCube();
 
+// Image based lighting from an HDR environment. The baked maps are stored in cache/, keyed by the HDR contents
+// and the bake settings, and loaded from there on later runs instead of baking again.
 class Skybox {
 public:
     Skybox(const char* hdri_path);
     ~Skybox();
 
+    // loads every baked map from the cache when there is an entry, the HDR is only decoded for a bake
     void generateCubemap(unsigned int cubemapSize);
-    void generateIrradianceMap();
+    // bakes the prefilter map and the BRDF LUT unless they came from the cache, then writes the entry
+    void generatePrefilterMap();
+    // filters the environment into the prefilter map again, e.g. after the environment changed
+    void bakePrefilterMap();
     void render(unsigned int cubemap_size);
 
-    unsigned int getIrradianceMap() const { return irradianceMap; }
+    // diffuse lighting of the environment, for the irradiance uniform block
+    const IrradianceData& getIrradianceSH() const { return irradianceSH; }
     unsigned int getPrefilterMap() const { return prefilterMap; }
     unsigned int getBrdfLUTTexture() const { return brdfLUTTexture; }
     unsigned int getEnvCubemap() const { return envCubemap; }
+    double getPrefilterBakeMilliseconds() const { return prefilterBakeMilliseconds; }
+
+    // bake every face and level of the prefilter map in one compute dispatch instead of a draw per face and level
+    bool computePrefilter = true;
 
 private:
-    unsigned int hdrTexture;
+    std::string hdriPath;
+    uint64_t cacheKey = 0;
+    bool loadedFromCache = false;
+
+    unsigned int hdrTexture = 0;
     unsigned int captureFBO;
     unsigned int captureRBO;
     unsigned int envCubemap;
-    unsigned int irradianceMap;
+    IrradianceData irradianceSH = {};
     unsigned int prefilterMap;
     unsigned int brdfLUTTexture;
+    unsigned int cubemapSize = 0;
+    double prefilterBakeMilliseconds = 0.0;
+
+    void loadHDR();
+    uint64_t computeCacheKey() const;
+    bool loadCache();
+    void writeCache();
 };
@@ -0,0 +1,147 @@
+#include "texture_cache.h"
+
+#include <iostream>
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include "common.h"
+#include "material_system.h"
+#include "texture_uploader.h"
+
+TextureCache& TextureCache::get()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+std::string TextureCache::makeKey(const std::string& path, bool flip)
+{
+    return flip ? path + "#flipped" : path;
+}
+
+unsigned int TextureCache::createTexture(const unsigned char* data, int width, int height, int components, size_t& bytes)
+{
+    bytes = 0;
+    if (!data) {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        return textureID;
+    }
+
+    UploadImage image = UploadImage::fromPixels(width, height, components);
+    unsigned int textureID = image.createTexture();
+    TextureUpload(textureID, image, data, {}).finish();
+    bytes = image.getResidentBytes();
+    return textureID;
+}
+
+unsigned int TextureCache::createTexture(const CompressedImage& compressed, size_t& bytes)
+{
+    UploadImage image = UploadImage::fromCompressed(compressed);
+    unsigned int textureID = image.createTexture();
+    TextureUpload(textureID, image, compressed.data.data(), {}).finish();
+    bytes = image.getResidentBytes();
+    return textureID;
+}
+
+unsigned int TextureCache::acquire(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        stats.misses++;
+        return 0;
+    }
+
+    Entry& entry = it->second;
+    if (entry.refCount == 0)
+        unreferenced.erase(entry.lruPosition);
+    entry.refCount++;
+    stats.hits++;
+    return entry.id;
+}
+
+unsigned int TextureCache::insert(const std::string& key, unsigned int id, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        glDeleteTextures(1, &id);
+        Entry& entry = it->second;
+        if (entry.refCount == 0)
+            unreferenced.erase(entry.lruPosition);
+        entry.refCount++;
+        return entry.id;
+    }
+
+    entries.emplace(key, Entry { id, bytes, 1, unreferenced.end() });
+    stats.textureCount++;
+    stats.residentBytes += bytes;
+    return id;
+}
+
+unsigned int TextureCache::load(const std::string& path, bool flip)
+{
+    std::string key = makeKey(path, flip);
+    unsigned int id = acquire(key);
+    if (id)
+        return id;
+
+    int width, height, nrComponents;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
+    if (data) {
+        if (flip)
+            flipImageVertically(data, width, height, nrComponents);
+    } else {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+    }
+
+    size_t bytes;
+    id = createTexture(data, width, height, nrComponents, bytes);
+    stbi_image_free(data);
+    return insert(key, id, bytes);
+}
+
+void TextureCache::release(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = entries.find(key);
+    if (it == entries.end() || it->second.refCount == 0)
+        return;
+
+    Entry& entry = it->second;
+    if (--entry.refCount == 0) {
+        unreferenced.push_front(key);
+        entry.lruPosition = unreferenced.begin();
+    }
+}
+
+void TextureCache::trim()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    MaterialSystem& materials = MaterialSystem::get();
+    while (budgetBytes > 0 && stats.residentBytes + materials.getArrayBytes() > budgetBytes && !unreferenced.empty()) {
+        auto it = entries.find(unreferenced.back());
+        unreferenced.pop_back();
+
+        materials.releaseTexture(it->second.id);
+        glDeleteTextures(1, &it->second.id);
+        stats.residentBytes -= it->second.bytes;
+        stats.textureCount--;
+        stats.evictions++;
+        entries.erase(it);
+    }
+}
+
+TextureCache::Stats TextureCache::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats total = stats;
+    total.residentBytes += MaterialSystem::get().getArrayBytes();
+    return total;
+}
@@ -0,0 +1,72 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "compressed_texture.h"
+
+// Process wide cache of 2D textures loaded from files, keyed by path. Every user acquires a texture once and
+// releases it when done. Textures nobody references stay resident so a later load is free, until the resident
+// size goes over the budget and trim() evicts them, least recently released first. The resident size includes the
+// copies MaterialSystem keeps in texture arrays, evicting a texture frees its copy too.
+// Lookups and reference counting may happen on any thread, GL calls (insert, load, trim) and getStats() only on the
+// render thread.
+class TextureCache {
+public:
+    struct Stats {
+        unsigned int hits = 0;
+        unsigned int misses = 0;
+        unsigned int evictions = 0;
+        unsigned int textureCount = 0;
+        // the textures and their material array copies
+        size_t residentBytes = 0;
+    };
+
+    static TextureCache& get();
+
+    // cache key of an image file, flipped and unflipped decodes of a file are different textures
+    static std::string makeKey(const std::string& path, bool flip);
+    // creates a mipmapped, repeating texture from decoded 8 bit pixels, a blank texture without data
+    static unsigned int createTexture(const unsigned char* data, int width, int height, int components, size_t& bytes);
+    // uploads a cooked mip chain, no mips are generated at runtime
+    static unsigned int createTexture(const CompressedImage& image, size_t& bytes);
+
+    // returns the texture and adds a reference, 0 (counted as a miss) when it isn't resident
+    unsigned int acquire(const std::string& key);
+    // adds a texture created for key with one reference. When another thread inserted key first, the new
+    // texture is deleted and the resident one returned instead.
+    unsigned int insert(const std::string& key, unsigned int id, size_t bytes);
+    // decodes and uploads the file on a miss, acquire + insert in one call
+    unsigned int load(const std::string& path, bool flip = false);
+    void release(const std::string& key);
+
+    // evicts unreferenced textures until the resident size fits budgetBytes, 0 means unlimited
+    void trim();
+
+    size_t budgetBytes = 0;
+
+    Stats getStats();
+
+private:
+    struct Entry {
+        unsigned int id;
+        size_t bytes;
+        unsigned int refCount;
+        // position in unreferenced while refCount is 0
+        std::list<std::string>::iterator lruPosition;
+    };
+
+    TextureCache() = default;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    // unreferenced textures, most recently released at the front
+    std::list<std::string> unreferenced;
+    Stats stats;
+};
+
+#endif
@@ -0,0 +1,343 @@
+#include "texture_uploader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// offsets are aligned for any texel and block size
+static constexpr size_t ALLOCATION_ALIGNMENT = 256;
+
+UploadImage UploadImage::fromPixels(int width, int height, int components, GLenum type, bool generateMipmaps)
+{
+    UploadImage image;
+    size_t componentSize = type == GL_FLOAT ? 4 : 1;
+    if (components == 1) {
+        image.format = GL_RED;
+        image.internalFormat = type == GL_FLOAT ? GL_R16F : GL_R8;
+    } else if (components == 3) {
+        image.format = GL_RGB;
+        image.internalFormat = type == GL_FLOAT ? GL_RGB16F : GL_RGB8;
+    } else {
+        image.format = GL_RGBA;
+        image.internalFormat = type == GL_FLOAT ? GL_RGBA16F : GL_RGBA8;
+    }
+    image.type = type;
+    image.generateMipmaps = generateMipmaps;
+
+    size_t rowBytes = static_cast<size_t>(width) * components * componentSize;
+    image.levels.push_back({ width, height, 0, rowBytes, 1 });
+    image.size = rowBytes * height;
+    return image;
+}
+
+UploadImage UploadImage::fromCompressed(const CompressedImage& compressed)
+{
+    UploadImage image;
+    image.internalFormat = compressed.format;
+    image.format = compressed.format;
+    image.compressed = true;
+    for (const CompressedImage::Level& level : compressed.levels) {
+        int blockRows = (level.height + 3) / 4;
+        image.levels.push_back({ level.width, level.height, level.offset, level.size / blockRows, 4 });
+    }
+    image.size = compressed.data.size();
+    return image;
+}
+
+unsigned int UploadImage::createTexture() const
+{
+    const UploadLevel& base = levels[0];
+    int levelCount = static_cast<int>(levels.size());
+    if (generateMipmaps)
+        levelCount = static_cast<int>(std::log2(std::max(base.width, base.height))) + 1;
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, internalFormat, base.width, base.height);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
+
+size_t UploadImage::getResidentBytes() const
+{
+    if (compressed)
+        return size;
+
+    const UploadLevel& base = levels[0];
+    size_t texelBytes = base.rowBytes / base.width;
+    // drivers pad three channel textures to four
+    if (format == GL_RGB)
+        texelBytes = texelBytes / 3 * 4;
+    size_t bytes = static_cast<size_t>(base.width) * base.height * texelBytes;
+    // the mip chain adds a third
+    return generateMipmaps ? bytes * 4 / 3 : bytes;
+}
+
+TextureUploader& TextureUploader::get()
+{
+    static TextureUploader uploader(64 << 20);
+    return uploader;
+}
+
+TextureUploader::TextureUploader(size_t ringSize)
+    : ringSize(ringSize)
+{
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+
+    if (GLAD_GL_VERSION_4_4 && glBufferStorage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ringSize, nullptr, flags);
+        memory = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ringSize, flags));
+        persistent = memory != nullptr;
+    }
+    if (!persistent) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, ringSize, nullptr, GL_STREAM_DRAW);
+        clientMemory.resize(ringSize);
+        memory = clientMemory.data();
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    stats.ringSize = ringSize;
+    stats.persistent = persistent;
+}
+
+TextureUploader::Allocation TextureUploader::allocate(size_t size, bool staging)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t alignedSize = (size + ALLOCATION_ALIGNMENT - 1) / ALLOCATION_ALIGNMENT * ALLOCATION_ALIGNMENT;
+    size_t offset = 0;
+    bool fits = false;
+    if (staging && getUsedBytes() + alignedSize > ringSize / 2) {
+        return Allocation();
+    } else if (blocks.empty()) {
+        head = 0;
+        fits = alignedSize <= ringSize;
+    } else {
+        size_t tail = blocks.front().offset;
+        if (head > tail) {
+            // free space is the end of the ring, then the start up to the oldest block
+            if (head + alignedSize <= ringSize) {
+                offset = head;
+                fits = true;
+            } else if (alignedSize < tail) {
+                offset = 0;
+                fits = true;
+            }
+        } else if (head + alignedSize < tail) {
+            offset = head;
+            fits = true;
+        }
+    }
+
+    if (!fits) {
+        if (!staging) {
+            stalled = true;
+            stats.stalls++;
+        }
+        return Allocation();
+    }
+
+    Allocation allocation;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.data = memory + offset;
+    allocation.id = nextId++;
+
+    blocks.push_back({ offset, alignedSize, allocation.id, false, 0 });
+    head = offset + alignedSize;
+    return allocation;
+}
+
+void TextureUploader::release(const Allocation& allocation)
+{
+    if (!allocation.isValid())
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Block& block : blocks) {
+        if (block.id == allocation.id) {
+            block.released = true;
+            block.generation = generation;
+            break;
+        }
+    }
+}
+
+bool TextureUploader::uploadRows(unsigned int texture, const UploadImage& image, int levelIndex, int firstRow, int rowCount, const unsigned char* pixels, const Allocation& staged, bool direct)
+{
+    const UploadLevel& level = image.levels[levelIndex];
+    size_t size = rowCount * level.rowBytes;
+    size_t sourceOffset = level.offset + firstRow * level.rowBytes;
+
+    Allocation slice;
+    // the source handed to GL, an offset into the bound unpack buffer or a client pointer
+    const unsigned char* source;
+    if (staged.isValid()) {
+        source = reinterpret_cast<const unsigned char*>(staged.offset + sourceOffset);
+    } else if (direct) {
+        source = pixels + sourceOffset;
+    } else {
+        slice = allocate(size);
+        if (!slice.isValid())
+            return false;
+        std::memcpy(slice.data, pixels + sourceOffset, size);
+        source = reinterpret_cast<const unsigned char*>(slice.offset);
+    }
+
+    if (staged.isValid() || !direct) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        size_t bufferOffset = reinterpret_cast<size_t>(source);
+        if (!persistent)
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, bufferOffset, size, memory + bufferOffset);
+    }
+
+    // rows are tightly packed, e.g. three channel rows of odd width
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    int y = firstRow * level.rowHeight;
+    int height = std::min(rowCount * level.rowHeight, level.height - y);
+    if (image.compressed) {
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, levelIndex, 0, y, level.width, height, image.format, static_cast<GLsizei>(size), source);
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, levelIndex, 0, y, level.width, height, image.format, image.type, source);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    release(slice);
+    bytesThisSecond += size;
+    return true;
+}
+
+void TextureUploader::endFrame()
+{
+    fence();
+    retire();
+
+    stalled = false;
+
+    auto now = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(now - secondStart).count();
+    if (seconds >= 1.0) {
+        stats.bytesPerSecond = bytesThisSecond / seconds;
+        bytesThisSecond = 0;
+        secondStart = now;
+    }
+}
+
+void TextureUploader::waitForSpace()
+{
+    // uploads released since the last fence need one of their own
+    fence();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    GLsync oldest = fences.front().second;
+    glClientWaitSync(oldest, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    stats.waits++;
+    stats.waitMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    retire();
+}
+
+bool TextureUploader::isBlocked()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return !blocks.empty() && !blocks.front().released;
+}
+
+TextureUploader::Stats TextureUploader::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.ringUsed = getUsedBytes();
+    return stats;
+}
+
+size_t TextureUploader::getUsedBytes() const
+{
+    if (blocks.empty())
+        return 0;
+    size_t tail = blocks.front().offset;
+    return head > tail ? head - tail : ringSize - tail + head;
+}
+
+void TextureUploader::fence()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    fences.push_back({ generation, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+    generation++;
+}
+
+void TextureUploader::retire()
+{
+    while (!fences.empty()) {
+        GLenum result = glClientWaitSync(fences.front().second, 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+            break;
+        completedGeneration = fences.front().first + 1;
+        glDeleteSync(fences.front().second);
+        fences.pop_front();
+    }
+
+    // blocks are freed in allocation order, a block still in use keeps the ones after it
+    std::lock_guard<std::mutex> lock(mutex);
+    while (!blocks.empty() && blocks.front().released && blocks.front().generation < completedGeneration)
+        blocks.pop_front();
+}
+
+TextureUpload::TextureUpload(unsigned int texture, UploadImage image, const unsigned char* pixels, TextureUploader::Allocation staged)
+    : texture(texture)
+    , image(std::move(image))
+    , pixels(pixels)
+    , staged(staged)
+{
+}
+
+bool TextureUpload::step()
+{
+    if (!isActive())
+        return true;
+
+    TextureUploader& uploader = TextureUploader::get();
+    const UploadLevel& level = image.levels[levelIndex];
+    int rowCount = static_cast<int>(std::max<size_t>(uploader.sliceBytes / level.rowBytes, 1));
+    rowCount = std::min(rowCount, level.getRowCount() - row);
+
+    stalled = !uploader.uploadRows(texture, image, static_cast<int>(levelIndex), row, rowCount, pixels, staged);
+    // nothing will free up before this upload is done, go around the ring
+    if (stalled && uploader.isBlocked())
+        stalled = !uploader.uploadRows(texture, image, static_cast<int>(levelIndex), row, rowCount, pixels, staged, true);
+    if (stalled)
+        return false;
+
+    row += rowCount;
+    if (row < level.getRowCount())
+        return false;
+    row = 0;
+    if (++levelIndex < image.levels.size())
+        return false;
+
+    if (image.generateMipmaps) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    uploader.release(staged);
+    texture = 0;
+    return true;
+}
+
+void TextureUpload::finish()
+{
+    while (!step()) {
+        if (stalled)
+            TextureUploader::get().waitForSpace();
+    }
+}
@@ -0,0 +1,171 @@
+#ifndef TEXTURE_UPLOADER_H
+#define TEXTURE_UPLOADER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "compressed_texture.h"
+
+// One mip level of an image, stored row after row. Compressed levels count rows of 4x4 blocks.
+struct UploadLevel {
+    int width;
+    int height;
+    // from the start of the image data
+    size_t offset;
+    size_t rowBytes;
+    int rowHeight;
+
+    int getRowCount() const { return (height + rowHeight - 1) / rowHeight; }
+};
+
+// Layout of the pixels of a texture to upload, every level back to back.
+struct UploadImage {
+    GLenum internalFormat = 0;
+    GLenum format = 0;
+    GLenum type = 0;
+    bool compressed = false;
+    // only level 0 is uploaded, the rest is generated once it is complete
+    bool generateMipmaps = false;
+    std::vector<UploadLevel> levels;
+    size_t size = 0;
+
+    static UploadImage fromPixels(int width, int height, int components, GLenum type = GL_UNSIGNED_BYTE, bool generateMipmaps = true);
+    static UploadImage fromCompressed(const CompressedImage& image);
+
+    // immutable storage for every level, repeating and trilinear filtered
+    unsigned int createTexture() const;
+    // estimated video memory of the texture, three channel formats are padded to four
+    size_t getResidentBytes() const;
+};
+
+// Streams texture data to the GPU through one pixel unpack buffer used as a ring. The ring is persistently
+// mapped when the driver has GL 4.4 buffer storage, so worker threads can copy decoded pixels straight into it;
+// otherwise the copies go to client memory and are sent with glBufferSubData right before their upload.
+// Every part of the ring is reused only after a fence shows the GPU has finished the uploads reading it.
+// Allocation and release may happen on any thread, uploads and fences only on the render thread.
+class TextureUploader {
+public:
+    struct Allocation {
+        size_t offset = 0;
+        size_t size = 0;
+        unsigned char* data = nullptr;
+        uint64_t id = 0;
+
+        bool isValid() const { return data != nullptr; }
+    };
+
+    struct Stats {
+        size_t ringSize = 0;
+        size_t ringUsed = 0;
+        bool persistent = false;
+        // averaged over the last second
+        double bytesPerSecond = 0.0;
+        // allocations that didn't fit, the upload waited for the next frame
+        unsigned int stalls = 0;
+        // blocking fence waits of synchronous uploads
+        unsigned int waits = 0;
+        double waitMilliseconds = 0.0;
+    };
+
+    // the first call creates the ring and has to come from the render thread. The buffer is left to the context
+    // on exit, the static instance outlives it.
+    static TextureUploader& get();
+
+    // reserves ring space, invalid (and a stall) while the ring is full. Staging allocations, made by workers
+    // ahead of the upload, only take up to half of the ring and never count as stalls.
+    Allocation allocate(size_t size, bool staging = false);
+    // the space is reused once the GPU is done with the uploads issued so far
+    void release(const Allocation& allocation);
+
+    // uploads rows [firstRow, firstRow + rowCount) of a level, from staged when valid (offsets as in the image),
+    // otherwise copied from pixels through a new allocation. false if that doesn't fit right now.
+    // direct skips the ring and uploads from pixels like a plain glTexSubImage2D.
+    bool uploadRows(unsigned int texture, const UploadImage& image, int levelIndex, int firstRow, int rowCount, const unsigned char* pixels, const Allocation& staged, bool direct = false);
+
+    // fences this frame's uploads and frees the ring space of the ones the GPU finished, once per frame
+    void endFrame();
+    // blocks until the oldest pending uploads are done, for synchronous uploads that ran out of space
+    void waitForSpace();
+
+    // set when an allocation failed this frame, further uploads can wait for the next one
+    bool hasStalled() const { return stalled; }
+    // the oldest allocation is still waiting for its upload, e.g. staged by a worker for a model further back in
+    // the queue. Space is freed in order, so waiting doesn't help until it is released.
+    bool isBlocked();
+    Stats getStats();
+
+    // bytes a TextureUpload sends per step
+    size_t sliceBytes = 4 << 20;
+
+private:
+    struct Block {
+        size_t offset;
+        size_t size;
+        uint64_t id;
+        bool released;
+        // fence generation the block was released in
+        uint64_t generation;
+    };
+
+    explicit TextureUploader(size_t ringSize);
+
+    unsigned int buffer = 0;
+    size_t ringSize;
+    unsigned char* memory = nullptr;
+    // client copy of the ring without buffer storage
+    std::vector<unsigned char> clientMemory;
+    bool persistent = false;
+
+    std::mutex mutex;
+    std::deque<Block> blocks;
+    size_t head = 0;
+    uint64_t nextId = 1;
+    std::atomic<bool> stalled { false };
+
+    std::deque<std::pair<uint64_t, GLsync>> fences;
+    uint64_t generation = 0;
+    uint64_t completedGeneration = 0;
+
+    Stats stats;
+    size_t bytesThisSecond = 0;
+    std::chrono::high_resolution_clock::time_point secondStart = std::chrono::high_resolution_clock::now();
+
+    size_t getUsedBytes() const;
+    void fence();
+    void retire();
+};
+
+// Uploads one texture in slices of TextureUploader::sliceBytes, level by level, so a big texture is spread
+// over several frames.
+class TextureUpload {
+public:
+    TextureUpload() = default;
+    // pixels (or staged, when valid) has to stay alive until the upload is done
+    TextureUpload(unsigned int texture, UploadImage image, const unsigned char* pixels, TextureUploader::Allocation staged);
+
+    // sends the next slice, returns true once everything is uploaded
+    bool step();
+    // uploads the rest right away, waiting for ring space when needed
+    void finish();
+
+    bool isActive() const { return texture != 0; }
+    // the last step didn't get ring space
+    bool isStalled() const { return stalled; }
+
+private:
+    unsigned int texture = 0;
+    UploadImage image;
+    const unsigned char* pixels = nullptr;
+    TextureUploader::Allocation staged;
+    size_t levelIndex = 0;
+    int row = 0;
+    bool stalled = false;
+};
+
+#endif
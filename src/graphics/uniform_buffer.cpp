@@ -0,0 +1,29 @@
+#include "uniform_buffer.h"
+
+UniformBuffer::UniformBuffer(GLenum target, unsigned int binding)
+    : target(target)
+    , binding(binding)
+{
+    glGenBuffers(1, &ID);
+}
+
+void UniformBuffer::upload(const void* data, size_t size)
+{
+    glBindBuffer(target, ID);
+
+    // keep some storage around even when empty, binding a zero sized buffer is an error
+    if (size > capacity || capacity == 0) {
+        capacity = size > 0 ? size * 2 : 256;
+        glBufferData(target, capacity, NULL, GL_DYNAMIC_DRAW);
+    }
+    if (size > 0) {
+        glBufferSubData(target, 0, size, data);
+    }
+
+    glBindBuffer(target, 0);
+}
+
+void UniformBuffer::bind() const
+{
+    glBindBufferBase(target, binding, ID);
+}
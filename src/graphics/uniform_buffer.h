@@ -0,0 +1,41 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// A uniform (GL_UNIFORM_BUFFER) or shader storage (GL_SHADER_STORAGE_BUFFER) buffer tied to one indexed binding point.
+// Every upload replaces the whole contents; storage only grows, so uploading the same amount each frame never reallocates.
+class UniformBuffer {
+public:
+    UniformBuffer(GLenum target, unsigned int binding);
+
+    void upload(const void* data, size_t size);
+
+    template <typename T>
+    void upload(const T& value)
+    {
+        upload(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void upload(const std::vector<T>& values)
+    {
+        upload(values.data(), values.size() * sizeof(T));
+    }
+
+    // binds the buffer to its binding point, shaders declare the same index with layout(binding = N)
+    void bind() const;
+
+    unsigned int getID() const { return ID; }
+    size_t getCapacity() const { return capacity; }
+
+private:
+    GLenum target;
+    unsigned int binding;
+    unsigned int ID;
+    size_t capacity = 0;
+};
+
+#endif
@@ -4,6 +4,7 @@
 // purpose library for handling windows, inputs, OpenGL/Vulkan graphics context
 // creation, etc.)
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <stdio.h>
@@ -26,24 +27,35 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/matrix_decompose.hpp>
 
+#include "utils/benchmarks.h"
 #include "utils/dd.h"
 #include "utils/debug_draw.hpp"
 
+#include "graphics/asset_loader.h"
 #include "graphics/camera.h"
+#include "graphics/cascaded_shadows.h"
+#include "graphics/culling.h"
 #include "graphics/entity.h"
+#include "graphics/frame_data.h"
+#include "graphics/instance_culler.h"
 #include "graphics/light.h"
+#include "graphics/light_clusters.h"
+#include "graphics/material_system.h"
 #include "graphics/model.h"
+#include "graphics/point_shadow_renderer.h"
+#include "graphics/render_target_pool.h"
 #include "graphics/shader.h"
+#include "graphics/shadow_atlas.h"
+#include "graphics/shadow_cache.h"
 #include "graphics/skybox.h"
+#include "graphics/texture_cache.h"
+#include "graphics/texture_uploader.h"
+#include "graphics/uniform_buffer.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-#define SPOT_DEPTH_MAP_COUNT 10
-#define DIRECTIONAL_DEPTH_MAP_COUNT 10
-#define POINT_DEPTH_MAP_COUNT 10
-
 #include "utils/gui.h"
 
 #include "ImGuizmo.h"
@@ -66,6 +78,13 @@ float lastY = screenHeight / 2.0f;
 bool firstMouse = true;
 bool cameraMouseControl = false;
 bool drawDebugLights = true;
+bool showClusterHeatmap = false;
+int pointShadowMode = static_cast<int>(PointShadowMode::GEOMETRY_SHADER);
+bool benchmarkPointShadows = false;
+// time per frame the render thread spends uploading loaded models
+float assetUploadBudget = 2.0f;
+// resident size unreferenced textures are evicted down to, 0 keeps them all
+int textureBudgetMB = 0;
 
 float viewportWidth = 0.0f;
 float viewportHeight = 0.0f;
@@ -80,39 +99,23 @@ bool useFxaa = false;
 bool fxaaDebugDraw = false;
 float lumaThreshold = 0.5f;
 
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const* path)
+// creates a layered depth texture (2D array) holding one shadow map per layer
+// -------------------------------------------------------------------------------------------
+unsigned int createDepthMapArray(GLenum target, int width, int height, int layers)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
+    glBindTexture(target, textureID);
+    glTexImage3D(target, 0, GL_DEPTH_COMPONENT, width, height, layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    } else {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, borderColor);
 
+    glBindTexture(target, 0);
     return textureID;
 }
 
@@ -222,6 +225,7 @@ int main(int, char**)
     bool show_demo_window = false;
     ImVec4 clear_color = ImVec4(0.1f, 0.1f, 0.1f, 1.00f);
 
+    // never flipped by stb_image itself, the asset loader decodes on other threads. See flipImageVertically()
     stbi_set_flip_vertically_on_load(false);
 
     camera.ProcessMouseMovement(90.0f / SENSITIVITY, -15.0f / SENSITIVITY);
@@ -250,13 +254,11 @@ int main(int, char**)
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 
-    Shader pbrAmbientShader("pbr/pbr.vert", "pbr/pbr_ambient.frag");
-    Shader pbrDirectionalShader("pbr/pbr.vert", "pbr/pbr_directional.frag");
-    Shader pbrPointShader("pbr/pbr.vert", "pbr/pbr_point.frag");
-    Shader pbrSpotlightShader("pbr/pbr.vert", "pbr/pbr_spotlight.frag");
+    Shader pbrShader("pbr/pbr.vert", "pbr/pbr.frag", nullptr, MaterialSystem::get().getShaderDefines());
 
     Shader shadowMapShader("shadow_map.vert", "shadow_map.frag");
-    Shader pointShadowMapShader("point_shadow_map.vert", "point_shadow_map.frag", "point_shadow_map.geom");
+    Shader cascadedShadowMapShader("shadow_map_cascades.vert", "shadow_map.frag", "shadow_map_cascades.geom");
+    PointShadowRenderer pointShadowRenderer;
 
     Shader postprocessShader("postprocess.vert", "postprocess.frag");
 
@@ -265,21 +267,30 @@ int main(int, char**)
 
     Shader backgroundShader("background.vert", "background.frag");
 
-    // scene_root.addChild(std::make_unique<Model>("Sponza", "resources/models/bistro/bistro.gltf"));
-    scene_root.addChild(std::make_unique<Model>("Sponza", "resources/models/sponza/Sponza.gltf"));
-    Entity* sponza = scene_root.children.back().get();
+    // stages every texture upload, created here so worker threads never create it
+    TextureUploader& textureUploader = TextureUploader::get();
+    // every texture loaded from a file, shared between models
+    TextureCache& textureCache = TextureCache::get();
+
+    // models are parsed and decoded in the background and show up in the scene once uploaded
+    AssetLoader assetLoader;
+
+    // assetLoader.loadModel(std::make_unique<Model>("Sponza"), "resources/models/bistro/bistro.gltf", &scene_root);
+    auto sponza = std::make_unique<Model>("Sponza");
     sponza->transform.scale = { 0.01, 0.01, 0.01 };
+    assetLoader.loadModel(std::move(sponza), "resources/models/sponza/Sponza.gltf", &scene_root);
 
-    scene_root.addChild(std::make_unique<Model>("Boombox", "resources/models/boombox/Boombox.gltf"));
-    Entity* boombox = scene_root.children.back().get();
+    auto boombox = std::make_unique<Model>("Boombox");
     boombox->transform.pos = { 1.4, 0.46, 0.87 };
     boombox->transform.scale = { 50.0, 50.0, 50.0 };
-    scene_root.addChild(std::make_unique<Model>("Helmet", "resources/models/damaged_helmet/DamagedHelmet.gltf"));
-    Entity* helmet = scene_root.children.back().get();
+    assetLoader.loadModel(std::move(boombox), "resources/models/boombox/Boombox.gltf", &scene_root);
+
+    auto helmet = std::make_unique<Model>("Helmet");
     helmet->transform.pos = { 1.8, 1.25, -1.0 };
     helmet->transform.orient = glm::angleAxis(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)) * helmet->transform.orient;
     helmet->transform.orient = glm::angleAxis(glm::radians(-45.0f), glm::vec3(0.0f, 1.0f, 0.0f)) * helmet->transform.orient;
     helmet->transform.scale = { 0.5, 0.5, 0.5 };
+    assetLoader.loadModel(std::move(helmet), "resources/models/damaged_helmet/DamagedHelmet.gltf", &scene_root);
 
     scene_root.addChild(std::make_unique<Entity>("Lights"));
     Entity* lights = scene_root.children.back().get();
@@ -316,83 +327,34 @@ int main(int, char**)
     postprocessShader.setFloat("u_minReduce", 1.0f / 128.0f);
     postprocessShader.setFloat("u_maxSpan", 8.0f);
 
-    pbrAmbientShader.use();
-    pbrAmbientShader.setInt("irradianceMap", 0);
-    pbrAmbientShader.setInt("prefilterMap", 1);
-    pbrAmbientShader.setInt("brdfLUT", 2);
-
-    pbrAmbientShader.setInt("albedo_map", 3);
-    pbrAmbientShader.setInt("normal_map", 4);
-    pbrAmbientShader.setInt("metallic_map", 5);
-    pbrAmbientShader.setInt("roughness_map", 6);
-    pbrAmbientShader.setInt("ao_map", 7);
-    pbrAmbientShader.setInt("emission_map", 8);
-
-    pbrDirectionalShader.use();
-    pbrDirectionalShader.setInt("albedo_map", 3);
-    pbrDirectionalShader.setInt("normal_map", 4);
-    pbrDirectionalShader.setInt("metallic_map", 5);
-    pbrDirectionalShader.setInt("roughness_map", 6);
-    pbrDirectionalShader.setInt("ao_map", 7);
-    for (int i = 0; i < DIRECTIONAL_DEPTH_MAP_COUNT; i++) {
-        pbrDirectionalShader.setInt("shadow_maps[" + std::to_string(i) + "]", 9 + i);
-    }
+    pbrShader.use();
+    pbrShader.setInt("prefilterMap", 1);
+    pbrShader.setInt("brdfLUT", 2);
 
-    pbrPointShader.use();
-    pbrPointShader.setInt("albedo_map", 3);
-    pbrPointShader.setInt("normal_map", 4);
-    pbrPointShader.setInt("metallic_map", 5);
-    pbrPointShader.setInt("roughness_map", 6);
-    pbrPointShader.setInt("ao_map", 7);
-    for (int i = 0; i < POINT_DEPTH_MAP_COUNT; i++) {
-        pbrPointShader.setInt("shadow_maps[" + std::to_string(i) + "]", 9 + i);
-    }
-
-    pbrSpotlightShader.use();
-    pbrSpotlightShader.setInt("albedo_map", 3);
-    pbrSpotlightShader.setInt("normal_map", 4);
-    pbrSpotlightShader.setInt("metallic_map", 5);
-    pbrSpotlightShader.setInt("roughness_map", 6);
-    pbrSpotlightShader.setInt("ao_map", 7);
-    pbrSpotlightShader.setInt("shadow_map", 9);
-    for (int i = 0; i < SPOT_DEPTH_MAP_COUNT; i++) {
-        pbrSpotlightShader.setInt("shadow_maps[" + std::to_string(i) + "]", 9 + i);
-    }
+    pbrShader.setInt("directionalShadowMaps", 9);
+    pbrShader.setInt("shadowAtlas", 10);
 
     backgroundShader.use();
     backgroundShader.setInt("environmentMap", 0);
 
-    stbi_set_flip_vertically_on_load(true);
-
     // pbr: setup cubemap, irradiance map and prefilter map
     // ----------------------------------------------------
     Skybox skybox = Skybox("resources/textures/hdr/blaubeuren_church_square_4k.hdr");
     skybox.generateCubemap(2048);
-    skybox.generateIrradianceMap();
-
-    // load PBR material textures
-    // --------------------------
-    // rusted iron
-    unsigned int ironAlbedoMap = loadTexture("resources/textures/pbr/rusted_iron/albedo.png");
-    unsigned int ironNormalMap = loadTexture("resources/textures/pbr/rusted_iron/normal.png");
-    unsigned int ironMetallicMap = loadTexture("resources/textures/pbr/rusted_iron/metallic.png");
-    unsigned int ironRoughnessMap = loadTexture("resources/textures/pbr/rusted_iron/roughness.png");
-    unsigned int ironAOMap = loadTexture("resources/textures/pbr/rusted_iron/ao.png");
+    skybox.generatePrefilterMap();
 
     // load cube model
     // ------------------------------------------------------------------
-    Model box_textured("Box Textured", "resources/models/box_textured/BoxTextured.gltf");
+    Model box_textured("Box Textured", "resources/models/box_textured/BoxTextured.gltf", true);
 
-    // generate a large list of semi-random model transformation matrices
-    // ------------------------------------------------------------------
+    // generate a large list of semi-random instance transforms
+    // --------------------------------------------------------
     unsigned int amount = 1000000;
-    glm::mat4* modelMatrices;
-    modelMatrices = new glm::mat4[amount];
+    std::vector<InstanceData> instances(amount);
     srand(static_cast<unsigned int>(glfwGetTime())); // initialize random seed
     float radius = 100.0;
     float offset = 25.0f;
     for (unsigned int i = 0; i < amount; i++) {
-        glm::mat4 model = glm::mat4(1.0f);
         // 1. translation: displace along circle with 'radius' in range [-offset, offset]
         float angle = (float)i / (float)amount * 360.0f;
         float displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
@@ -401,57 +363,29 @@ int main(int, char**)
         float y = displacement * 0.4f; // keep height of asteroid field smaller compared to width of x and z
         displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
         float z = cos(angle) * radius + displacement;
-        model = glm::translate(model, glm::vec3(x, y, z));
 
         // 2. scale: Scale between 0.05 and 0.25f
         float scale = static_cast<float>((rand() % 20) / 100.0 + 0.05) * 0.5f;
-        model = glm::scale(model, glm::vec3(scale));
 
         // 3. rotation: add random rotation around a (semi)randomly picked rotation axis vector
         float rotAngle = static_cast<float>((rand() % 360));
-        model = glm::rotate(model, rotAngle, glm::vec3(0.4f, 0.6f, 0.8f));
+        glm::quat rotation = glm::angleAxis(rotAngle, glm::normalize(glm::vec3(0.4f, 0.6f, 0.8f)));
 
-        // 4. now add to list of matrices
-        modelMatrices[i] = model;
+        // 4. now add to list of instances
+        instances[i] = InstanceData::pack(glm::vec3(x, y, z), rotation, scale);
     }
 
     // terrain
-    int heightmapTexture = loadTexture("resources/textures/heightmap.png");
-    Model terrain("Terrain", "resources/models/plane.gltf");
+    int heightmapTexture = textureCache.load("resources/textures/heightmap.png", true);
+    Model terrain("Terrain", "resources/models/plane.gltf", true);
     terrainShader.use();
     terrainShader.setInt("heightMap", 0);
 
-    // configure instanced array
-    // -------------------------
-    unsigned int buffer;
-    glGenBuffers(1, &buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), &modelMatrices[0], GL_STATIC_DRAW);
-
-    // set transformation matrices as an instance vertex attribute (with divisor 1)
-    // note: we're cheating a little by taking the, now publicly declared, VAO of the model's mesh(es) and adding new vertexAttribPointers
-    // normally you'd want to do this in a more organized fashion, but for learning purposes this will do.
-    // -----------------------------------------------------------------------------------------------------------------------------------
-    for (unsigned int i = 0; i < box_textured.meshes.size(); i++) {
-        unsigned int VAO = box_textured.meshes[i].VAO;
-        glBindVertexArray(VAO);
-        // set attribute pointers for matrix (4 times vec4)
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4)));
-        glEnableVertexAttribArray(5);
-        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
-
-        glVertexAttribDivisor(3, 1);
-        glVertexAttribDivisor(4, 1);
-        glVertexAttribDivisor(5, 1);
-        glVertexAttribDivisor(6, 1);
-
-        glBindVertexArray(0);
-    }
+    // upload the instances once, they are culled and drawn on the GPU from here on
+    // -------------------------------------------------------------------------------
+    InstanceCuller boxCuller(instances, box_textured.meshes);
+    instances.clear();
+    instances.shrink_to_fit();
 
     unsigned int fbo;
     glGenFramebuffers(1, &fbo);
@@ -459,6 +393,18 @@ int main(int, char**)
 
     ImGuiWindowFlags viewportWindowFlags = 0;
 
+    RenderTargetPool renderTargetPool;
+
+    // per model mesh visibility from the camera, reused by all lighting passes of a frame
+    std::vector<std::vector<unsigned char>> cameraVisibility;
+    std::vector<std::vector<unsigned char>> shadowVisibility;
+    std::vector<unsigned char> cascadeVisibility;
+    CullStats cameraCullStats;
+    CullStats shadowCullStats;
+    LodStats cameraLodStats;
+    // model draws of the shadow and PBR passes, sorted to bind every program and material as few times as possible
+    RenderQueue renderQueue;
+
     DDRenderInterfaceCoreGL renderIface;
     dd::initialize(&renderIface);
 
@@ -466,59 +412,35 @@ int main(int, char**)
     glGenFramebuffers(1, &depthMapFBO);
     const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
 
-    std::vector<int> directionalDepthMaps;
-    std::vector<int> pointDepthMaps;
-    std::vector<int> spotDepthMaps;
-
-    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-
-    for (int i = 0; i < DIRECTIONAL_DEPTH_MAP_COUNT; i++) {
-        unsigned int directionalDepthMap;
-        glGenTextures(1, &directionalDepthMap);
-        glBindTexture(GL_TEXTURE_2D, directionalDepthMap);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-            SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-        directionalDepthMaps.push_back(directionalDepthMap);
-    }
-
-    for (int i = 0; i < SPOT_DEPTH_MAP_COUNT; i++) {
-        unsigned int spotlightDepthMap;
-        glGenTextures(1, &spotlightDepthMap);
-        glBindTexture(GL_TEXTURE_2D, spotlightDepthMap);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-            SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-        spotDepthMaps.push_back(spotlightDepthMap);
-    }
-
-    for (int i = 0; i < POINT_DEPTH_MAP_COUNT; i++) {
-        unsigned int pointDepthMap;
-        glGenTextures(1, &pointDepthMap);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, pointDepthMap);
-        for (unsigned int i = 0; i < 6; ++i)
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT,
-                SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-        pointDepthMaps.push_back(pointDepthMap);
-    }
+    // directional cascades are layers of one array texture, spot lights and point light faces get tiles of the atlas
+    unsigned int directionalDepthMaps = createDepthMapArray(GL_TEXTURE_2D_ARRAY, SHADOW_WIDTH, SHADOW_HEIGHT, DIRECTIONAL_DEPTH_MAP_COUNT);
+    ShadowAtlas shadowAtlas(4096, 64, 1024);
+    // (coverage, index into clusteredLights) of every spot and point light that wants a shadow
+    std::vector<std::pair<float, size_t>> shadowRequests;
+    std::vector<ShadowTileData> shadowTiles;
+    std::vector<glm::uvec4> shadowTileRects;
+
+    CascadedShadows cascadedShadows;
+
+    // shadow map layers are only redrawn when their light or one of their casters changed
+    ShadowCache shadowCache;
+
+    LightClusters lightClusters;
+    std::vector<ClusteredLight> clusteredLights;
+
+    // per-frame shader data, uploaded once and shared by every program through fixed binding points
+    UniformBuffer cameraBuffer(GL_UNIFORM_BUFFER, CAMERA_UNIFORM_BINDING);
+    UniformBuffer shadowBuffer(GL_UNIFORM_BUFFER, SHADOW_UNIFORM_BINDING);
+    UniformBuffer directionalLightBuffer(GL_SHADER_STORAGE_BUFFER, DIRECTIONAL_LIGHT_BUFFER_BINDING);
+    UniformBuffer shadowTileBuffer(GL_SHADER_STORAGE_BUFFER, SHADOW_TILE_BUFFER_BINDING);
+    // only changes with the environment
+    UniformBuffer irradianceBuffer(GL_UNIFORM_BUFFER, IRRADIANCE_UNIFORM_BINDING);
+    irradianceBuffer.upload(skybox.getIrradianceSH());
+    ShadowData shadowData = {};
+    std::vector<DirectionalLightData> directionalLights;
 
     glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, directionalDepthMaps[0], 0);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, directionalDepthMaps, 0, 0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -547,6 +469,10 @@ int main(int, char**)
 
         processInput(window);
 
+        assetLoader.processUploads(assetUploadBudget);
+        textureCache.budgetBytes = static_cast<size_t>(textureBudgetMB) << 20;
+        textureCache.trim();
+
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -648,8 +574,8 @@ int main(int, char**)
                         ImGui::DragFloat("Spotlight Outer Angle", &light->outerAngle, 0.1f, 0.0f, 180.0f);
                         // ImGui::DragFloat("Spotlight Falloff", &light->cutOffDistance, 0.1f, 0.0f, 20.0f);
                     }
-                    if (light->type == LightType::POINT) {
-                        // ImGui::DragFloat("Radius", &light->radius, 0.1f, 0.0f, 20.0f);
+                    if (light->type == LightType::POINT || light->type == LightType::SPOT) {
+                        ImGui::DragFloat("Range", &light->range, 0.1f, 0.1f, 100.0f);
                     }
                 }
             }
@@ -669,6 +595,15 @@ int main(int, char**)
             ImGui::DragFloat("LUMA Threshold", &lumaThreshold, 0.01f, 0.0f, 1.0f, "%.2f");
 
             ImGui::Checkbox("Draw Debug Lights", &drawDebugLights);
+            ImGui::Checkbox("Show Light Clusters", &showClusterHeatmap);
+            ImGui::Combo("Point Shadows", &pointShadowMode, "Geometry Shader\0Vertex Shader Viewport\0Per Face\0");
+            if (!pointShadowRenderer.isSupported(static_cast<PointShadowMode>(pointShadowMode))) {
+                ImGui::Text("Not supported, falling back to per face");
+            }
+            ImGui::Checkbox("Cache Shadow Maps", &shadowCache.enabled);
+            ImGui::SliderInt("Shadow Cascades", &cascadedShadows.cascadeCount, 1, MAX_SHADOW_CASCADES);
+            ImGui::SliderFloat("Cascade Split Lambda", &cascadedShadows.splitLambda, 0.0f, 1.0f);
+            ImGui::SliderFloat("Shadow Distance", &cascadedShadows.shadowDistance, 5.0f, 500.0f);
             static bool drawGrid = false;
             ImGui::Checkbox("Draw Grid", &drawGrid);
             if (drawGrid) {
@@ -679,10 +614,67 @@ int main(int, char**)
                 &show_demo_window); // Edit bools storing our window
                                     // open/close state
 
+            if (ImGui::Button("Benchmark Uniform Setters")) {
+                benchmarkUniformSetters(pbrShader);
+            }
+            // runs during the next shadow pass, it needs a point light with a shadow
+            if (ImGui::Button("Benchmark Point Shadows")) {
+                benchmarkPointShadows = true;
+            }
+            ImGui::Checkbox("Compute Prefilter", &skybox.computePrefilter);
+            if (ImGui::Button("Rebake Prefilter Map")) {
+                skybox.bakePrefilterMap();
+            }
+            ImGui::Checkbox("Multi Draw Indirect", &GeometryPool::multiDrawEnabled);
+            ImGui::Checkbox("Sort Draws", &RenderQueue::sortingEnabled);
+            ImGui::DragFloat("LOD Error (px)", &Mesh::lodPixelError, 0.05f, 0.0f, 16.0f, "%.2f");
+            ImGui::DragFloat("Asset Upload Budget (ms)", &assetUploadBudget, 0.1f, 0.1f, 16.0f, "%.1f");
+            ImGui::DragInt("Texture Budget (MB)", &textureBudgetMB, 8.0f, 0, 8192);
+
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                 1000.0f / ImGui::GetIO().Framerate,
                 ImGui::GetIO().Framerate);
 
+            ImGui::Text("Meshes (camera): %u drawn, %u culled", cameraCullStats.drawn, cameraCullStats.culled);
+            ImGui::Text("Meshes (shadows): %u drawn, %u culled", shadowCullStats.drawn, shadowCullStats.culled);
+            ImGui::Text("Instances: %u visible of %u", boxCuller.getVisibleCount(), boxCuller.getInstanceCount());
+            ImGui::Text("Triangles (camera): %u with LODs, %u full", cameraLodStats.triangles, cameraLodStats.fullTriangles);
+            GeometryPool::Stats geometryStats = GeometryPool::get().getStats();
+            ImGui::Text("Draw calls: %u for %u meshes, geometry pool %.1f MB", geometryStats.drawCalls, geometryStats.drawnMeshes,
+                (geometryStats.vertexBytes + geometryStats.indexBytes) / (1024.0 * 1024.0));
+            RenderQueue::Stats queueStats = renderQueue.getStats();
+            ImGui::Text("Render queue: %u packets, %u draws, %u program / %u uniform changes", queueStats.packets,
+                queueStats.drawCalls, queueStats.programChanges, queueStats.uniformChanges);
+            MaterialSystem::Stats materialStats = MaterialSystem::get().getStats();
+            if (materialStats.bindless) {
+                ImGui::Text("Materials: %u with %u bindless textures", materialStats.materialCount, materialStats.textureCount);
+            } else {
+                ImGui::Text("Materials: %u, %u textures in %u arrays (%zu layers)", materialStats.materialCount, materialStats.textureCount,
+                    materialStats.arrayCount, materialStats.arrayLayers);
+            }
+            ImGui::Text("Shadow maps: %u rendered, %u cached", shadowCache.getStats().rendered, shadowCache.getStats().cached);
+            ImGui::Text("Models: %u loaded, %u loading", assetLoader.getLoadedCount(), assetLoader.getPendingCount());
+            TextureCache::Stats textureStats = textureCache.getStats();
+            ImGui::Text("Textures: %u resident (%.1f MB), %u hits, %u misses, %u evicted", textureStats.textureCount,
+                textureStats.residentBytes / (1024.0 * 1024.0), textureStats.hits, textureStats.misses, textureStats.evictions);
+            TextureUploader::Stats uploadStats = textureUploader.getStats();
+            ImGui::Text("Texture uploads: %.1f MB/s, %u stalls, %u waits (%.1f ms), ring %.0f/%.0f MB (%s)",
+                uploadStats.bytesPerSecond / (1024.0 * 1024.0), uploadStats.stalls, uploadStats.waits, uploadStats.waitMilliseconds,
+                uploadStats.ringUsed / (1024.0 * 1024.0), uploadStats.ringSize / (1024.0 * 1024.0), uploadStats.persistent ? "persistent" : "client copy");
+            ImGui::Text("Prefilter bake: %.2f ms", skybox.getPrefilterBakeMilliseconds());
+            ImGui::Text("Shadow atlas: %u tiles, %.0f%% used", shadowAtlas.getTileCount(), shadowAtlas.getUsage() * 100.0f);
+
+            const LightClusters::Stats& clusterStats = lightClusters.getStats();
+            ImGui::Text("Clustered lights: %u (%u indices)", clusterStats.lightCount, clusterStats.indexCount);
+            ImGui::Text("Light clusters: %u occupied, max %u lights", clusterStats.occupiedClusters, clusterStats.maxLightsPerCluster);
+
+            // stats are from the previous frame, the pool is only flushed after the viewport has been drawn
+            const RenderTargetPool::FrameStats& targetStats = renderTargetPool.getFrameStats();
+            ImGui::Text("Render targets: %u allocated, %u reused, %u released",
+                targetStats.allocations, targetStats.reuses, targetStats.releases);
+            ImGui::Text("Render targets resident: %u (%.1f MB)",
+                targetStats.residentTargets, targetStats.residentBytes / (1024.0f * 1024.0f));
+
             ImGui::End();
         }
 
@@ -710,9 +702,8 @@ int main(int, char**)
 
         glBindFramebuffer(GL_FRAMEBUFFER, fbo);
 
-        GLuint renderTexture;
-        GLuint postprocessTexture;
-        unsigned int rbo;
+        renderTargetPool.beginFrame();
+
         ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
 
         ImGui::Begin("Viewport", 0, viewportWindowFlags);
@@ -723,31 +714,17 @@ int main(int, char**)
 
             glm::mat4 projection = camera.getProjectionMatrix(viewportWidth, viewportHeight);
             glm::mat4 view = camera.getViewMatrix();
+            Frustum cameraFrustum = Frustum::fromMatrix(projection * view);
 
-            glGenTextures(1, &renderTexture);
-            glBindTexture(GL_TEXTURE_2D, renderTexture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, viewportWidth, viewportHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            glBindTexture(GL_TEXTURE_2D, 0);
-
-            glGenTextures(1, &postprocessTexture);
-            glBindTexture(GL_TEXTURE_2D, postprocessTexture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, viewportWidth, viewportHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            glBindTexture(GL_TEXTURE_2D, 0);
+            // render targets are recycled by the pool and only reallocated when the viewport size changes
+            int targetWidth = static_cast<int>(viewportWidth);
+            int targetHeight = static_cast<int>(viewportHeight);
+            GLuint renderTexture = renderTargetPool.acquireTexture(targetWidth, targetHeight, GL_RGB, GL_RGB, GL_UNSIGNED_BYTE);
+            GLuint postprocessTexture = renderTargetPool.acquireTexture(targetWidth, targetHeight, GL_RGB, GL_RGB, GL_UNSIGNED_BYTE);
+            unsigned int rbo = renderTargetPool.acquireRenderbuffer(targetWidth, targetHeight, GL_DEPTH24_STENCIL8);
 
             // attach it to currently bound framebuffer object
             glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderTexture, 0);
-
-            glGenRenderbuffers(1, &rbo);
-            glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, viewportWidth, viewportHeight);
-            glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
             glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
 
             glViewport(0, 0, viewportWidth, viewportHeight);
@@ -767,49 +744,12 @@ int main(int, char**)
             glfwMakeContextCurrent(window);
             glfwGetFramebufferSize(window, &display_w, &display_h);
 
-            // Set shader uniforms
-            pbrDirectionalShader.use();
-            pbrDirectionalShader.setMat4("projection", projection);
-            pbrDirectionalShader.setMat4("view", view);
-            pbrDirectionalShader.setVec3("camPos", camera.Position);
-
-            pbrPointShader.use();
-            pbrPointShader.setMat4("projection", projection);
-            pbrPointShader.setMat4("view", view);
-            pbrPointShader.setVec3("camPos", camera.Position);
-
-            pbrSpotlightShader.use();
-            pbrSpotlightShader.setMat4("projection", projection);
-            pbrSpotlightShader.setMat4("view", view);
-            pbrSpotlightShader.setVec3("camPos", camera.Position);
-
-            pbrAmbientShader.use();
-            pbrAmbientShader.setMat4("projection", projection);
-            pbrAmbientShader.setMat4("view", view);
-            pbrAmbientShader.setVec3("camPos", camera.Position);
-
-            pbrAmbientShader.setFloat("ambientIntensity", ambientIntensity);
-
-            // bind pre-computed IBL data
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, skybox.getIrradianceMap());
+            // bind pre-computed IBL data, diffuse irradiance comes from its uniform block
             glActiveTexture(GL_TEXTURE1);
             glBindTexture(GL_TEXTURE_CUBE_MAP, skybox.getPrefilterMap());
             glActiveTexture(GL_TEXTURE2);
             glBindTexture(GL_TEXTURE_2D, skybox.getBrdfLUTTexture());
 
-            // rusted iron
-            glActiveTexture(GL_TEXTURE3);
-            glBindTexture(GL_TEXTURE_2D, ironAlbedoMap);
-            glActiveTexture(GL_TEXTURE4);
-            glBindTexture(GL_TEXTURE_2D, ironNormalMap);
-            glActiveTexture(GL_TEXTURE5);
-            glBindTexture(GL_TEXTURE_2D, ironMetallicMap);
-            glActiveTexture(GL_TEXTURE6);
-            glBindTexture(GL_TEXTURE_2D, ironRoughnessMap);
-            glActiveTexture(GL_TEXTURE7);
-            glBindTexture(GL_TEXTURE_2D, ironAOMap);
-
             glm::mat4 model = glm::mat4(1.0f);
 
             std::vector<Model*> models;
@@ -836,12 +776,56 @@ int main(int, char**)
                 }
             }
 
-            int directionalLightCount = 0;
-            int pointLightCount = 0;
-            int spotLightCount = 0;
+            cameraCullStats.reset();
+            shadowCullStats.reset();
+            GeometryPool::get().resetFrameStats();
+            renderQueue.resetFrameStats();
+            shadowCache.resetStats();
+
+            cameraVisibility.resize(models.size());
+            for (size_t i = 0; i < models.size(); i++) {
+                models[i]->cull(cameraFrustum, cameraVisibility[i], cameraCullStats);
+            }
+
+            // levels of detail follow the camera, shadow passes draw the same ones
+            cameraLodStats.reset();
+            float pixelsPerUnit = viewportHeight * projection[1][1] * 0.5f;
+            for (size_t i = 0; i < models.size(); i++) {
+                models[i]->selectLods(camera.Position, pixelsPerUnit, cameraVisibility[i], cameraLodStats);
+            }
+
+            // gather every light and shadow matrix first, so all of it is uploaded once before the passes run
+            int directionalShadowCount = 0;
+
+            directionalLights.clear();
+            clusteredLights.clear();
+            shadowRequests.clear();
 
-            std::vector<glm::mat4> spotLightSpaceMatrices;
-            std::vector<glm::mat4> directionalLightSpaceMatrices;
+            // screen space importance of a light: the fraction of the viewport height its range covers, 0 if it can't be seen
+            auto shadowCoverage = [&](const glm::vec3& position, float range) {
+                AABB lightBounds;
+                lightBounds.min = position - glm::vec3(range);
+                lightBounds.max = position + glm::vec3(range);
+                if (!cameraFrustum.intersects(lightBounds)) {
+                    return 0.0f;
+                }
+
+                float distance = glm::length(position - camera.Position);
+                return glm::min(range * projection[1][1] / glm::max(distance, range), 1.0f);
+            };
+
+            // directional lights share the cascade splits, every light fits its own cascades into them
+            cascadedShadows.update(view, projection, camera.nearPlane, camera.farPlane);
+            int cascadeCount = cascadedShadows.getCascadeCount();
+            for (int i = 0; i < MAX_SHADOW_CASCADES; i++) {
+                shadowData.cascadeSplits[i] = i < cascadeCount ? cascadedShadows.getSplit(i) : 0.0f;
+            }
+            shadowData.cascadeCount = cascadeCount;
+
+            AABB sceneBounds;
+            for (auto& model : models) {
+                sceneBounds.expand(model->bounds);
+            }
 
             for (auto& light : lights) {
                 glm::vec3 lightPos = glm::vec3(light->transform.modelMatrix[3]);
@@ -851,226 +835,329 @@ int main(int, char**)
                     if (drawDebugLights)
                         dd::arrow(&lightPos[0], &to[0], &light->color[0], 0.25f);
 
-                    pbrDirectionalShader.use();
-                    pbrDirectionalShader.setVec3("lights[" + std::to_string(directionalLightCount) + "].direction", -lightDir);
-                    pbrDirectionalShader.setVec3("lights[" + std::to_string(directionalLightCount) + "].color", light->color);
-                    pbrDirectionalShader.setFloat("lights[" + std::to_string(directionalLightCount) + "].intensity", light->intensity);
+                    DirectionalLightData directionalLight = {};
+                    directionalLight.direction = -lightDir;
+                    directionalLight.color = light->color;
+                    directionalLight.intensity = light->intensity;
+                    directionalLight.shadowIndex = -1;
 
-                    if (directionalLightCount >= POINT_DEPTH_MAP_COUNT) {
-                        directionalLightCount++;
-                        continue;
+                    if (directionalShadowCount + cascadeCount <= DIRECTIONAL_DEPTH_MAP_COUNT) {
+                        cascadedShadows.computeLightMatrices(lightDir, sceneBounds, SHADOW_WIDTH, &shadowData.directionalLightSpaceMatrices[directionalShadowCount]);
+                        directionalLight.shadowIndex = directionalShadowCount;
+                        directionalShadowCount += cascadeCount;
                     }
 
-                    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-                    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, directionalDepthMaps[directionalLightCount], 0);
-                    glClear(GL_DEPTH_BUFFER_BIT);
-                    glCullFace(GL_FRONT);
-
-                    float nearPlane = 1.0f, farPlane = 20.0f;
-                    float size = 20.0f;
-                    glm::mat4 lightProjection = glm::ortho(-size, size, -size, size, nearPlane, farPlane);
-                    glm::mat4 lightView = glm::lookAt(lightPos, lightPos + lightDir, glm::vec3(0.0f, 1.0f, 0.0f));
-                    glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-                    directionalLightSpaceMatrices.push_back(lightSpaceMatrix);
-                    shadowMapShader.use();
-                    shadowMapShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-                    for (auto& model : models) {
-                        glm::mat4 modelMatrix = model->transform.modelMatrix;
-                        shadowMapShader.setMat4("model", modelMatrix);
-                        model->Draw(shadowMapShader);
-                    }
-
-                    glCullFace(GL_BACK);
-
-                    directionalLightCount++;
+                    directionalLights.push_back(directionalLight);
                 } else if (light->type == LightType::POINT) {
                     if (drawDebugLights)
                         dd::cross(&lightPos[0], 0.5f);
                     // dd::sphere(&lightPos[0], &light->color[0], 0.25f);
 
-                    pbrPointShader.use();
-                    pbrPointShader.setVec3("lights[" + std::to_string(pointLightCount) + "].position", lightPos);
-                    pbrPointShader.setVec3("lights[" + std::to_string(pointLightCount) + "].color", light->color);
-                    pbrPointShader.setFloat("lights[" + std::to_string(pointLightCount) + "].intensity", light->intensity);
+                    ClusteredLight clusteredLight = {};
+                    clusteredLight.position = lightPos;
+                    clusteredLight.range = light->range;
+                    clusteredLight.color = light->color;
+                    clusteredLight.intensity = light->intensity;
+                    clusteredLight.type = static_cast<int>(ClusteredLightType::POINT);
+                    clusteredLight.shadowIndex = -1;
 
-                    if (pointLightCount >= POINT_DEPTH_MAP_COUNT) {
-                        pointLightCount++;
-                        continue;
-                    }
-
-                    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-                    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-                    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, pointDepthMaps[pointLightCount], 0);
-                    glDrawBuffer(GL_NONE);
-                    glReadBuffer(GL_NONE);
-
-                    glClear(GL_DEPTH_BUFFER_BIT);
-                    glCullFace(GL_FRONT);
+                    float coverage = shadowCoverage(lightPos, light->range);
+                    if (coverage > 0.0f)
+                        shadowRequests.push_back({ coverage, clusteredLights.size() });
 
-                    float aspect = (float)SHADOW_WIDTH / (float)SHADOW_HEIGHT;
-                    float near_plane = 1.0f;
-                    float far_plane = 25.0f;
-                    glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), aspect, near_plane, far_plane);
-
-                    std::vector<glm::mat4> shadowTransforms;
+                    clusteredLights.push_back(clusteredLight);
+                } else if (light->type == LightType::SPOT) {
+                    glm::vec3 lightDir = glm::normalize(glm::vec3(light->transform.modelMatrix * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f)));
+                    glm::vec3 coneDir = lightDir * light->range;
+                    float baseRadius = tanf(glm::radians(light->outerAngle)) * light->range;
+                    if (drawDebugLights)
+                        dd::cone(&lightPos[0], &coneDir[0], &light->color[0], baseRadius, 0.0f);
+
+                    ClusteredLight clusteredLight = {};
+                    clusteredLight.position = lightPos;
+                    clusteredLight.range = light->range;
+                    clusteredLight.color = light->color;
+                    clusteredLight.intensity = light->intensity;
+                    clusteredLight.direction = lightDir;
+                    clusteredLight.type = static_cast<int>(ClusteredLightType::SPOT);
+                    clusteredLight.innerAngleCos = glm::cos(glm::radians(light->innerAngle));
+                    clusteredLight.outerAngleCos = glm::cos(glm::radians(light->outerAngle));
+                    clusteredLight.shadowIndex = -1;
+
+                    float coverage = shadowCoverage(lightPos, light->range);
+                    if (coverage > 0.0f)
+                        shadowRequests.push_back({ coverage, clusteredLights.size() });
+
+                    clusteredLights.push_back(clusteredLight);
+                }
+            }
 
-                    shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0)));
-                    shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(-1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0)));
-                    shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, 0.0, 1.0)));
-                    shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, -1.0, 0.0), glm::vec3(0.0, 0.0, -1.0)));
-                    shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 0.0, 1.0), glm::vec3(0.0, -1.0, 0.0)));
-                    shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, -1.0, 0.0)));
+            // hand out atlas tiles by importance, the largest first so the quadtree doesn't fragment.
+            // Lights that don't fit anymore, not even with smaller tiles, get no shadows.
+            shadowAtlas.reset();
+            shadowTiles.clear();
+            shadowTileRects.clear();
+            std::stable_sort(shadowRequests.begin(), shadowRequests.end(), [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) {
+                return a.first > b.first;
+            });
+
+            for (auto& request : shadowRequests) {
+                ClusteredLight& clusteredLight = clusteredLights[request.second];
+                bool isPoint = clusteredLight.type == static_cast<int>(ClusteredLightType::POINT);
+                size_t faceCount = isPoint ? 6 : 1;
+                size_t firstTile = shadowTileRects.size();
+
+                // a cube face covers much less of the screen than the whole light
+                unsigned int tileSize = shadowAtlas.getTileSize(isPoint ? request.first * 0.5f : request.first);
+                bool allocated = false;
+                for (; !allocated && tileSize >= shadowAtlas.getMinTileSize(); tileSize >>= 1) {
+                    glm::uvec4 rect;
+                    while (shadowTileRects.size() - firstTile < faceCount && shadowAtlas.allocate(tileSize, rect)) {
+                        shadowTileRects.push_back(rect);
+                    }
 
-                    pointShadowMapShader.use();
+                    allocated = shadowTileRects.size() - firstTile == faceCount;
+                    if (!allocated) {
+                        // a point light needs all six faces, give back the ones it got
+                        for (size_t i = firstTile; i < shadowTileRects.size(); i++) {
+                            shadowAtlas.release(shadowTileRects[i]);
+                        }
+                        shadowTileRects.resize(firstTile);
+                    }
+                }
+                if (!allocated) {
+                    continue;
+                }
 
-                    for (unsigned int i = 0; i < 6; ++i)
-                        pointShadowMapShader.setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
+                glm::vec3 lightPos = clusteredLight.position;
+                clusteredLight.shadowIndex = static_cast<int>(firstTile);
+
+                if (isPoint) {
+                    glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, clusteredLight.range);
+                    glm::mat4 shadowTransforms[6];
+                    shadowTransforms[0] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
+                    shadowTransforms[1] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(-1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
+                    shadowTransforms[2] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, 0.0, 1.0));
+                    shadowTransforms[3] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, -1.0, 0.0), glm::vec3(0.0, 0.0, -1.0));
+                    shadowTransforms[4] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 0.0, 1.0), glm::vec3(0.0, -1.0, 0.0));
+                    shadowTransforms[5] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, -1.0, 0.0));
+
+                    for (size_t face = 0; face < 6; face++) {
+                        shadowTiles.push_back({ shadowTransforms[face], shadowAtlas.getUVRect(shadowTileRects[firstTile + face]) });
+                    }
+                } else {
+                    // fit the frustum to the cone instead of a fixed 90 degrees
+                    float fov = glm::min(2.0f * glm::acos(clusteredLight.outerAngleCos), glm::radians(120.0f));
+                    glm::vec3 up = glm::abs(clusteredLight.direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+                    glm::mat4 lightProjection = glm::perspective(fov, 1.0f, 0.1f, clusteredLight.range);
+                    glm::mat4 lightView = glm::lookAt(lightPos, lightPos + clusteredLight.direction, up);
+                    shadowTiles.push_back({ lightProjection * lightView, shadowAtlas.getUVRect(shadowTileRects[firstTile]) });
+                }
+            }
 
-                    pointShadowMapShader.setFloat("far_plane", far_plane);
-                    pointShadowMapShader.setVec3("lightPos", lightPos);
+            // tiles that moved may now cover what a cached light rendered before
+            if (shadowAtlas.hasLayoutChanged()) {
+                shadowCache.invalidate(DIRECTIONAL_DEPTH_MAP_COUNT);
+            }
 
-                    for (auto& model : models) {
-                        glm::mat4 modelMatrix = model->transform.modelMatrix;
-                        pointShadowMapShader.setMat4("model", modelMatrix);
-                        model->Draw(pointShadowMapShader);
+            CameraData cameraData = { projection, view, camera.Position, 0.0f };
+            cameraBuffer.upload(cameraData);
+            shadowBuffer.upload(shadowData);
+            directionalLightBuffer.upload(directionalLights);
+            shadowTileBuffer.upload(shadowTiles);
+
+            cameraBuffer.bind();
+            shadowBuffer.bind();
+            irradianceBuffer.bind();
+            directionalLightBuffer.bind();
+            shadowTileBuffer.bind();
+
+            // shadow passes
+            glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+            glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+            glCullFace(GL_FRONT);
+
+            // culls every caster against the light, the casters that are left make up the layer's signature together
+            // with the light itself. Stats only count the layers that are actually redrawn.
+            shadowVisibility.resize(models.size());
+            auto cullShadowCasters = [&](const Frustum* lightFrustums, int frustumCount, ShadowCache::Signature& signature) {
+                CullStats layerStats;
+                for (size_t m = 0; m < models.size(); m++) {
+                    CullStats modelStats;
+                    models[m]->cull(lightFrustums[0], shadowVisibility[m], modelStats);
+                    // frustums rendered in one pass share the draw, a mesh is needed if any of them sees it
+                    for (int f = 1; f < frustumCount; f++) {
+                        models[m]->cull(lightFrustums[f], cascadeVisibility, modelStats);
+                        for (size_t k = 0; k < cascadeVisibility.size(); k++) {
+                            shadowVisibility[m][k] |= cascadeVisibility[k];
+                        }
                     }
 
-                    pointLightCount++;
-                } else if (light->type == LightType::SPOT) {
-                    glm::vec3 lightDir = glm::vec3(light->transform.modelMatrix * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f)) * light->intensity;
-                    float baseRadius = tanf(glm::radians(light->outerAngle)) * light->intensity;
-                    if (drawDebugLights)
-                        dd::cone(&lightPos[0], &lightDir[0], &light->color[0], baseRadius, 0.0f);
-
-                    pbrSpotlightShader.use();
-                    pbrSpotlightShader.setVec3("lights[" + std::to_string(spotLightCount) + "].position", lightPos);
-                    pbrSpotlightShader.setVec3("lights[" + std::to_string(spotLightCount) + "].direction", glm::normalize(lightDir));
-                    pbrSpotlightShader.setVec3("lights[" + std::to_string(spotLightCount) + "].color", light->color);
-                    pbrSpotlightShader.setFloat("lights[" + std::to_string(spotLightCount) + "].intensity", light->intensity);
-                    pbrSpotlightShader.setFloat("lights[" + std::to_string(spotLightCount) + "].innerAngle", glm::cos(glm::radians(light->innerAngle)));
-                    pbrSpotlightShader.setFloat("lights[" + std::to_string(spotLightCount) + "].outerAngle", glm::cos(glm::radians(light->outerAngle)));
-
-                    if (spotLightCount >= SPOT_DEPTH_MAP_COUNT) {
-                        spotLightCount++;
-                        continue;
+                    unsigned int visibleCount = 0;
+                    for (unsigned char visible : shadowVisibility[m]) {
+                        visibleCount += visible;
                     }
-
-                    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-                    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, spotDepthMaps[spotLightCount], 0);
-                    glClear(GL_DEPTH_BUFFER_BIT);
-                    glCullFace(GL_FRONT);
-
-                    float nearPlane = 0.1f, farPlane = 20.0f;
-                    glm::mat4 lightProjection = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
-                    glm::mat4 lightView = glm::lookAt(lightPos, lightPos + glm::normalize(lightDir), glm::vec3(0.0f, 1.0f, 0.0f));
-                    glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-                    spotLightSpaceMatrices.push_back(lightSpaceMatrix);
-                    shadowMapShader.use();
-                    shadowMapShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-                    for (auto& model : models) {
-                        glm::mat4 modelMatrix = model->transform.modelMatrix;
-                        shadowMapShader.setMat4("model", modelMatrix);
-                        model->Draw(shadowMapShader);
+                    layerStats.drawn += visibleCount;
+                    layerStats.culled += static_cast<unsigned int>(shadowVisibility[m].size()) - visibleCount;
+
+                    // casters outside of the light's frustum cannot change its shadow map
+                    if (visibleCount > 0) {
+                        signature.add(models[m]);
+                        signature.add(models[m]->transform.version);
+                        signature.add(shadowVisibility[m].data(), shadowVisibility[m].size());
+                        signature.add(models[m]->getLodLevels().data(), models[m]->getLodLevels().size());
                     }
+                }
+                return layerStats;
+            };
 
-                    glCullFace(GL_BACK);
+            auto drawShadowCasters = [&](Shader& shader, const CullStats& layerStats) {
+                for (size_t m = 0; m < models.size(); m++) {
+                    models[m]->submit(renderQueue, RenderPass::SHADOW, shader, shadowVisibility[m], 0.0f);
+                }
+                renderQueue.execute();
+                shadowCullStats.drawn += layerStats.drawn;
+                shadowCullStats.culled += layerStats.culled;
+            };
+
+            // all cascades of a directional light are rendered in one pass, the geometry shader picks the layer
+            cascadedShadowMapShader.use();
+            for (int i = 0; i < directionalShadowCount; i += cascadeCount) {
+                Frustum cascadeFrustums[MAX_SHADOW_CASCADES];
+                ShadowCache::Signature signature;
+                for (int c = 0; c < cascadeCount; c++) {
+                    cascadeFrustums[c] = Frustum::fromMatrix(shadowData.directionalLightSpaceMatrices[i + c]);
+                    signature.add(shadowData.directionalLightSpaceMatrices[i + c]);
+                }
+                CullStats layerStats = cullShadowCasters(cascadeFrustums, cascadeCount, signature);
+                if (!shadowCache.needsUpdate(i, signature.get()))
+                    continue;
 
-                    spotLightCount++;
+                for (int c = 0; c < cascadeCount; c++) {
+                    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, directionalDepthMaps, 0, i + c);
+                    glClear(GL_DEPTH_BUFFER_BIT);
                 }
+                glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, directionalDepthMaps, 0);
+
+                cascadedShadowMapShader.setInt("layerOffset", i);
+                drawShadowCasters(cascadedShadowMapShader, layerStats);
             }
 
-            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-            glViewport(0, 0, viewportWidth, viewportHeight);
+            // spot lights and point light faces render into their atlas tiles, a scissor keeps clears inside the tile
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowAtlas.getTexture(), 0);
+            glEnable(GL_SCISSOR_TEST);
 
-            pbrDirectionalShader.use();
-            pbrDirectionalShader.setInt("lightCount", directionalLightCount);
+            shadowMapShader.use();
+            for (auto& clusteredLight : clusteredLights) {
+                if (clusteredLight.shadowIndex < 0 || clusteredLight.type != static_cast<int>(ClusteredLightType::SPOT))
+                    continue;
 
-            pbrPointShader.use();
-            pbrPointShader.setInt("lightCount", pointLightCount);
+                int tile = clusteredLight.shadowIndex;
+                const glm::mat4& lightSpaceMatrix = shadowTiles[tile].lightSpaceMatrix;
+                const glm::uvec4& rect = shadowTileRects[tile];
 
-            pbrSpotlightShader.use();
-            pbrSpotlightShader.setInt("lightCount", spotLightCount);
+                Frustum lightFrustum = Frustum::fromMatrix(lightSpaceMatrix);
+                ShadowCache::Signature signature;
+                signature.add(lightSpaceMatrix);
+                signature.add(rect);
+                CullStats layerStats = cullShadowCasters(&lightFrustum, 1, signature);
+                if (!shadowCache.needsUpdate(DIRECTIONAL_DEPTH_MAP_COUNT + tile, signature.get()))
+                    continue;
 
-            for (auto& model : models) {
-                pbrAmbientShader.use();
-                pbrAmbientShader.setMat4("model", model->transform.modelMatrix);
-                model->Draw(pbrAmbientShader);
+                glScissor(rect.x, rect.y, rect.z, rect.w);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                glViewport(rect.x, rect.y, rect.z, rect.w);
+                shadowMapShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
+                drawShadowCasters(shadowMapShader, layerStats);
+            }
 
-                if (model->isRefractive) {
+            for (auto& clusteredLight : clusteredLights) {
+                if (clusteredLight.shadowIndex < 0 || clusteredLight.type != static_cast<int>(ClusteredLightType::POINT))
                     continue;
-                }
 
-                glEnable(GL_BLEND);
-                glBlendFunc(GL_ONE, GL_ONE);
-                glDepthMask(GL_FALSE);
-                glDepthFunc(GL_EQUAL);
-
-                if (directionalLightCount > 0) {
-                    pbrDirectionalShader.use();
-                    pbrDirectionalShader.setMat4("model", model->transform.modelMatrix);
-                    for (int i = 0; i < directionalLightCount; i++) {
-                        pbrDirectionalShader.setMat4("lightSpaceMatrices[" + std::to_string(i) + "]", directionalLightSpaceMatrices[i]);
-                        glActiveTexture(GL_TEXTURE9 + i);
-                        glBindTexture(GL_TEXTURE_2D, directionalDepthMaps[i]);
-                    }
-                    model->Draw(pbrDirectionalShader);
-                }
+                int firstTile = clusteredLight.shadowIndex;
+                glm::vec3 lightPos = clusteredLight.position;
 
-                if (pointLightCount > 0) {
-                    pbrPointShader.use();
-                    pbrPointShader.setMat4("model", model->transform.modelMatrix);
-                    pbrPointShader.setVec3("viewPos", camera.Position);
-                    for (int i = 0; i < pointLightCount; i++) {
-                        glActiveTexture(GL_TEXTURE9 + i);
-                        glBindTexture(GL_TEXTURE_CUBE_MAP, pointDepthMaps[i]);
-                    }
-                    model->Draw(pbrPointShader);
+                PointShadowView pointShadow = { lightPos, clusteredLight.range, firstTile, &shadowTiles[firstTile], &shadowTileRects[firstTile] };
+
+                if (benchmarkPointShadows) {
+                    benchmarkPointShadowPaths(pointShadowRenderer, models, pointShadow);
+                    benchmarkPointShadows = false;
                 }
 
-                if (spotLightCount > 0) {
-                    pbrSpotlightShader.use();
-                    pbrSpotlightShader.setMat4("model", model->transform.modelMatrix);
-                    for (int i = 0; i < spotLightCount; i++) {
-                        pbrSpotlightShader.setMat4("lightSpaceMatrices[" + std::to_string(i) + "]", spotLightSpaceMatrices[i]);
-                        glActiveTexture(GL_TEXTURE9 + i);
-                        glBindTexture(GL_TEXTURE_2D, spotDepthMaps[i]);
-                    }
-                    model->Draw(pbrSpotlightShader);
+                // all six faces together cover the cube of the light's range around it
+                ShadowCache::Signature signature;
+                signature.add(lightPos);
+                signature.add(clusteredLight.range);
+                signature.add(&shadowTileRects[firstTile], sizeof(glm::uvec4) * 6);
+                signature.add(pointShadowMode);
+                Frustum lightFrustum = PointShadowRenderer::getCubeFrustum(lightPos, clusteredLight.range);
+                cullShadowCasters(&lightFrustum, 1, signature);
+                if (!shadowCache.needsUpdate(DIRECTIONAL_DEPTH_MAP_COUNT + firstTile, signature.get()))
+                    continue;
+
+                CullStats layerStats = pointShadowRenderer.render(static_cast<PointShadowMode>(pointShadowMode), models, shadowVisibility, pointShadow);
+                shadowCullStats.drawn += layerStats.drawn;
+                shadowCullStats.culled += layerStats.culled;
+            }
+
+            glDisable(GL_SCISSOR_TEST);
+            glCullFace(GL_BACK);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            glViewport(0, 0, viewportWidth, viewportHeight);
+
+            // bin point and spot lights into the view frustum clusters, the PBR pass only shades the lights of its cluster
+            lightClusters.update(clusteredLights, view, projection, camera.nearPlane, camera.farPlane);
+            lightClusters.bind();
+
+            pbrShader.use();
+            pbrShader.setFloat("ambientIntensity", ambientIntensity);
+            pbrShader.setInt("directionalLightCount", static_cast<int>(directionalLights.size()));
+
+            pbrShader.setVec2("clusterTileSize", viewportWidth / CLUSTER_GRID_X, viewportHeight / CLUSTER_GRID_Y);
+            pbrShader.setFloat("clusterSliceScale", lightClusters.getSliceScale());
+            pbrShader.setFloat("clusterSliceBias", lightClusters.getSliceBias());
+            pbrShader.setBool("showClusterHeatmap", showClusterHeatmap);
+
+            glActiveTexture(GL_TEXTURE9);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, directionalDepthMaps);
+            glActiveTexture(GL_TEXTURE10);
+            glBindTexture(GL_TEXTURE_2D, shadowAtlas.getTexture());
+            // every material and its textures, no draw binds any
+            MaterialSystem::get().bind(pbrShader);
+
+            for (size_t modelIndex = 0; modelIndex < models.size(); modelIndex++) {
+                Model* model = models[modelIndex];
+                if (!model->bounds.isValid() || !cameraFrustum.intersects(model->bounds)) {
+                    continue;
                 }
 
-                glDepthMask(GL_TRUE);
-                glDepthFunc(GL_LEQUAL);
-                glDisable(GL_BLEND);
+                // front to back, by the distance to the center of the model
+                float depth = glm::distance(camera.Position, model->bounds.getCenter());
+                model->submit(renderQueue, RenderPass::LIGHTING, pbrShader, cameraVisibility[modelIndex], depth);
             }
+            renderQueue.execute();
+
+            boxCuller.cull(cameraFrustum, camera.Position, pixelsPerUnit);
 
             instancedShader.use();
-            instancedShader.setMat4("projection", projection);
-            instancedShader.setMat4("view", view);
             instancedShader.setInt("texture_diffuse1", 0);
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, box_textured.textures_loaded[0].id);
-            for (unsigned int i = 0; i < box_textured.meshes.size(); i++) {
-                glBindVertexArray(box_textured.meshes[i].VAO);
-                glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(box_textured.meshes[i].indices.size()), GL_UNSIGNED_INT, 0, amount);
-                glBindVertexArray(0);
-            }
+            boxCuller.draw(instancedShader, box_textured.meshes);
 
             glm::mat4 terrainMatrix = glm::mat4(1.0f);
             terrainMatrix = glm::translate(terrainMatrix, glm::vec3(0.0f, -20.0f, 0.0f));
             terrainMatrix = glm::scale(terrainMatrix, glm::vec3(50.0f, 50.0f, 50.0f));
 
             terrainShader.use();
-            terrainShader.setMat4("projection", projection);
-            terrainShader.setMat4("view", view);
             terrainShader.setMat4("model", terrainMatrix);
             terrainShader.setInt("heightMap", 0);
             terrainShader.setFloat("time", glfwGetTime());
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, heightmapTexture);
-            glBindVertexArray(terrain.meshes[0].VAO);
-            glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(terrain.meshes[0].indices.size()), GL_UNSIGNED_INT, 0);
+            terrain.meshes[0].drawGeometry();
 
             for (auto& entity : misc_entities) {
                 const ddMat4x4 transform = {
@@ -1096,8 +1183,6 @@ int main(int, char**)
 
             // render skybox (render as last to prevent overdraw)
             backgroundShader.use();
-            backgroundShader.setMat4("view", view);
-            backgroundShader.setMat4("projection", projection);
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_CUBE_MAP, skybox.getEnvCubemap());
             renderCube();
@@ -1167,6 +1252,7 @@ int main(int, char**)
         ImGui::End();
 
         scene_root.updateSelfAndChildren();
+        textureUploader.endFrame();
 
         ImGui::PopStyleVar(1);
 
@@ -1177,9 +1263,7 @@ int main(int, char**)
 
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
-        glDeleteTextures(1, &renderTexture);
-        glDeleteTextures(1, &postprocessTexture);
-        glDeleteRenderbuffers(1, &rbo);
+        renderTargetPool.endFrame();
 
         glfwMakeContextCurrent(window);
         glfwSwapBuffers(window);
@@ -1187,6 +1271,8 @@ int main(int, char**)
 
     dd::shutdown();
 
+    renderTargetPool.clear();
+
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -0,0 +1,95 @@
+#include "benchmarks.h"
+
+#include <chrono>
+
+#include <spdlog/spdlog.h>
+
+void benchmarkUniformSetters(Shader& shader, int iterations)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    shader.use();
+    glFinish();
+
+    // the per-draw uniforms of the render queue and per-frame ones of the PBR pass, set to their defaults. The frame
+    // sets the per-frame ones again before drawing.
+    const glm::mat4 identity = glm::mat4(1.0f);
+    const int callsPerIteration = 4;
+
+    // before: a std::string per call and a driver lookup per call
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        glUniform1i(glGetUniformLocation(shader.ID, std::string("isRefractive").c_str()), 0);
+        glUniformMatrix4fv(glGetUniformLocation(shader.ID, std::string("model").c_str()), 1, GL_FALSE, &identity[0][0]);
+        glUniform1f(glGetUniformLocation(shader.ID, std::string("ambientIntensity").c_str()), 1.0f);
+        glUniform1i(glGetUniformLocation(shader.ID, std::string("showClusterHeatmap").c_str()), 0);
+    }
+    glFinish();
+    double stringSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // after: compile time hashed names resolved through the reflected table
+    static constexpr UniformId IS_REFRACTIVE("isRefractive");
+    static constexpr UniformId MODEL("model");
+    static constexpr UniformId AMBIENT_INTENSITY("ambientIntensity");
+    static constexpr UniformId SHOW_CLUSTER_HEATMAP("showClusterHeatmap");
+
+    start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        shader.setBool(IS_REFRACTIVE, false);
+        shader.setMat4(MODEL, identity);
+        shader.setFloat(AMBIENT_INTENSITY, 1.0f);
+        shader.setBool(SHOW_CLUSTER_HEATMAP, false);
+    }
+    glFinish();
+    double cachedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    double calls = static_cast<double>(iterations) * callsPerIteration;
+    spdlog::info("Uniform setters: string lookup {:.2f} M calls/s, cached lookup {:.2f} M calls/s ({:.1f}x)",
+        calls / stringSeconds / 1e6, calls / cachedSeconds / 1e6, stringSeconds / cachedSeconds);
+}
+
+void benchmarkPointShadowPaths(PointShadowRenderer& renderer, const std::vector<Model*>& models, const PointShadowView& light, int iterations)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    // casters against the whole cube, like the shadow pass culls them
+    std::vector<std::vector<unsigned char>> visibility(models.size());
+    CullStats cubeStats;
+    Frustum cubeFrustum = PointShadowRenderer::getCubeFrustum(light.position, light.range);
+    for (size_t i = 0; i < models.size(); i++) {
+        models[i]->cull(cubeFrustum, visibility[i], cubeStats);
+    }
+
+    unsigned int query;
+    glGenQueries(1, &query);
+
+    const char* names[] = { "geometry shader", "vertex shader viewport", "per face" };
+    for (int i = 0; i < 3; i++) {
+        PointShadowMode mode = static_cast<PointShadowMode>(i);
+        if (!renderer.isSupported(mode)) {
+            spdlog::info("Point shadows ({}): not supported", names[i]);
+            continue;
+        }
+
+        // warm up, the first draw with a program may compile driver variants
+        renderer.render(mode, models, visibility, light);
+        glFinish();
+
+        CullStats stats;
+        auto start = Clock::now();
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int j = 0; j < iterations; j++) {
+            stats = renderer.render(mode, models, visibility, light);
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        double cpuSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        GLuint64 gpuNanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpuNanoseconds);
+
+        spdlog::info("Point shadows ({}): {:.3f} ms GPU, {:.3f} ms CPU per light, {} face meshes drawn, {} culled",
+            names[i], gpuNanoseconds / 1e6 / iterations, cpuSeconds * 1000.0 / iterations, stats.drawn, stats.culled);
+    }
+
+    glDeleteQueries(1, &query);
+}
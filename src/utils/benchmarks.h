@@ -0,0 +1,20 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <vector>
+
+#include "../graphics/model.h"
+#include "../graphics/point_shadow_renderer.h"
+#include "../graphics/shader.h"
+
+// In-app micro benchmarks, triggered from the Misc window. Results are logged.
+
+// Compares setting the uniforms Mesh::Draw sets per draw by string name + glGetUniformLocation
+// against the shader's cached location table. Needs a current GL context; leaves the shader bound.
+void benchmarkUniformSetters(Shader& shader, int iterations = 200000);
+
+// Renders one point light's shadow with every supported PointShadowMode and compares their GPU time (timer queries)
+// and CPU submission time. Must run inside the shadow pass, with the same state PointShadowRenderer::render expects.
+void benchmarkPointShadowPaths(PointShadowRenderer& renderer, const std::vector<Model*>& models, const PointShadowView& light, int iterations = 50);
+
+#endif
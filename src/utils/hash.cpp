@@ -0,0 +1,24 @@
+#include "hash.h"
+
+#include <fstream>
+
+uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t hashFile(uint64_t hash, const std::string& path)
+{
+    std::ifstream stream(path, std::ios::binary);
+    char buffer[1 << 16];
+    while (stream) {
+        stream.read(buffer, sizeof(buffer));
+        hash = hashBytes(hash, buffer, static_cast<size_t>(stream.gcount()));
+    }
+    return hash;
+}
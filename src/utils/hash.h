@@ -0,0 +1,15 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 64 bit FNV-1a, for cache keys of files on disk
+static constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+uint64_t hashBytes(uint64_t hash, const void* data, size_t size);
+// hashes the contents of the file, a missing file hashes like an empty one
+uint64_t hashFile(uint64_t hash, const std::string& path);
+
+#endif
@@ -0,0 +1,248 @@
+#include "bc_encoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Endpoints along the principal axis of the block's colors. Projecting onto the axis instead of taking the
+// bounding box diagonal keeps anti correlated channels (e.g. red against blue) apart.
+static void findEndpoints(const uint8_t* rgba, int channels, float low[4], float high[4])
+{
+    float mean[4] = {};
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < channels; c++)
+            mean[c] += rgba[i * 4 + c] / 16.0f;
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++)
+                covariance[a][b] += (rgba[i * 4 + a] - mean[a]) * (rgba[i * 4 + b] - mean[b]);
+        }
+    }
+
+    // power iteration, a few steps are plenty for a 4x4 matrix
+    float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        for (int a = 0; a < channels; a++)
+            for (int b = 0; b < channels; b++)
+                next[a] += covariance[a][b] * axis[b];
+
+        float length = 0.0f;
+        for (int c = 0; c < channels; c++)
+            length += next[c] * next[c];
+        length = std::sqrt(length);
+        // a flat block, any axis will do
+        if (length < 1e-6f)
+            break;
+        for (int c = 0; c < channels; c++)
+            axis[c] = next[c] / length;
+    }
+
+    float minProjection = 0.0f;
+    float maxProjection = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float projection = 0.0f;
+        for (int c = 0; c < channels; c++)
+            projection += (rgba[i * 4 + c] - mean[c]) * axis[c];
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+    }
+
+    for (int c = 0; c < channels; c++) {
+        low[c] = std::clamp(mean[c] + axis[c] * minProjection, 0.0f, 255.0f);
+        high[c] = std::clamp(mean[c] + axis[c] * maxProjection, 0.0f, 255.0f);
+    }
+}
+
+static int nearestIndex(const uint8_t* texel, const int (*palette)[4], int paletteSize, int channels)
+{
+    int best = 0;
+    int bestError = 0x7fffffff;
+    for (int i = 0; i < paletteSize; i++) {
+        int error = 0;
+        for (int c = 0; c < channels; c++) {
+            int difference = texel[c] - palette[i][c];
+            error += difference * difference;
+        }
+        if (error < bestError) {
+            bestError = error;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// BC1
+
+static uint16_t packRGB565(const float color[3])
+{
+    int r = static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f);
+    int g = static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f);
+    int b = static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(uint16_t packed, int color[4])
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+    color[3] = 255;
+}
+
+void encodeBC1(const uint8_t* rgba, uint8_t* block)
+{
+    float low[4], high[4];
+    findEndpoints(rgba, 3, low, high);
+
+    uint16_t color0 = packRGB565(high);
+    uint16_t color1 = packRGB565(low);
+    // color0 > color1 selects the four color mode
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int palette[4][4];
+        unpackRGB565(color0, palette[0]);
+        unpackRGB565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++)
+            indices |= static_cast<uint32_t>(nearestIndex(rgba + i * 4, palette, 4, 3)) << (i * 2);
+    }
+
+    std::memcpy(block, &color0, 2);
+    std::memcpy(block + 2, &color1, 2);
+    std::memcpy(block + 4, &indices, 4);
+}
+
+// BC4 / BC5
+
+static void encodeBC4(const uint8_t* rgba, int channel, uint8_t* block)
+{
+    int low = 255;
+    int high = 0;
+    for (int i = 0; i < 16; i++) {
+        low = std::min<int>(low, rgba[i * 4 + channel]);
+        high = std::max<int>(high, rgba[i * 4 + channel]);
+    }
+
+    std::memset(block, 0, 8);
+    block[0] = static_cast<uint8_t>(high);
+    block[1] = static_cast<uint8_t>(low);
+    if (high == low)
+        return;
+
+    // endpoint0 > endpoint1 selects eight interpolated values
+    int palette[8][4] = {};
+    palette[0][0] = high;
+    palette[1][0] = low;
+    for (int i = 2; i < 8; i++)
+        palette[i][0] = ((8 - i) * high + (i - 1) * low) / 7;
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 16; i++) {
+        uint8_t value = rgba[i * 4 + channel];
+        indices |= static_cast<uint64_t>(nearestIndex(&value, palette, 8, 1)) << (i * 3);
+    }
+    for (int i = 0; i < 6; i++)
+        block[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+}
+
+void encodeBC5(const uint8_t* rgba, uint8_t* block)
+{
+    encodeBC4(rgba, 0, block);
+    encodeBC4(rgba, 1, block + 8);
+}
+
+// BC7
+
+static const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BitWriter {
+    uint8_t* bytes;
+    int position = 0;
+
+    void write(uint32_t value, int count)
+    {
+        for (int i = 0; i < count; i++, position++) {
+            if (value & (1u << i))
+                bytes[position / 8] |= 1u << (position % 8);
+        }
+    }
+};
+
+void encodeBC7(const uint8_t* rgba, uint8_t* block)
+{
+    float low[4], high[4];
+    findEndpoints(rgba, 4, low, high);
+
+    // try every p-bit combination, keep the one with the smallest error
+    int bestEndpoints[2][4] = {};
+    int bestPBits[2] = {};
+    int bestIndices[16] = {};
+    int bestError = 0x7fffffff;
+    for (int pBits = 0; pBits < 4; pBits++) {
+        int p[2] = { pBits & 1, pBits >> 1 };
+        int endpoints[2][4];
+        int expanded[2][4];
+        for (int c = 0; c < 4; c++) {
+            endpoints[0][c] = std::clamp(static_cast<int>((low[c] - p[0]) / 2.0f + 0.5f), 0, 127);
+            endpoints[1][c] = std::clamp(static_cast<int>((high[c] - p[1]) / 2.0f + 0.5f), 0, 127);
+            expanded[0][c] = (endpoints[0][c] << 1) | p[0];
+            expanded[1][c] = (endpoints[1][c] << 1) | p[1];
+        }
+
+        int palette[16][4];
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 4; c++)
+                palette[i][c] = ((64 - BC7_WEIGHTS4[i]) * expanded[0][c] + BC7_WEIGHTS4[i] * expanded[1][c] + 32) >> 6;
+
+        int indices[16];
+        int error = 0;
+        for (int i = 0; i < 16; i++) {
+            indices[i] = nearestIndex(rgba + i * 4, palette, 16, 4);
+            for (int c = 0; c < 4; c++) {
+                int difference = rgba[i * 4 + c] - palette[indices[i]][c];
+                error += difference * difference;
+            }
+        }
+
+        if (error < bestError) {
+            bestError = error;
+            std::memcpy(bestEndpoints, endpoints, sizeof(endpoints));
+            std::memcpy(bestPBits, p, sizeof(p));
+            std::memcpy(bestIndices, indices, sizeof(indices));
+        }
+    }
+
+    // the first index is stored without its top bit, it has to be below 8
+    if (bestIndices[0] >= 8) {
+        for (int c = 0; c < 4; c++)
+            std::swap(bestEndpoints[0][c], bestEndpoints[1][c]);
+        std::swap(bestPBits[0], bestPBits[1]);
+        for (int i = 0; i < 16; i++)
+            bestIndices[i] = 15 - bestIndices[i];
+    }
+
+    std::memset(block, 0, 16);
+    BitWriter writer { block };
+    writer.write(1u << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        writer.write(bestEndpoints[0][c], 7);
+        writer.write(bestEndpoints[1][c], 7);
+    }
+    writer.write(bestPBits[0], 1);
+    writer.write(bestPBits[1], 1);
+    writer.write(bestIndices[0], 3);
+    for (int i = 1; i < 16; i++)
+        writer.write(bestIndices[i], 4);
+}
@@ -0,0 +1,15 @@
+#ifndef BC_ENCODER_H
+#define BC_ENCODER_H
+
+#include <cstdint>
+
+// Block compression encoders. Every function takes one 4x4 block of RGBA8 texels in row order.
+
+// 8 bytes, opaque RGB (4 color mode only)
+void encodeBC1(const uint8_t* rgba, uint8_t* block);
+// 16 bytes, red and green as two BC4 blocks, meant for tangent space normal maps
+void encodeBC5(const uint8_t* rgba, uint8_t* block);
+// 16 bytes, RGBA with mode 6 (one subset, 7 bit endpoints with p-bits, 4 bit indices)
+void encodeBC7(const uint8_t* rgba, uint8_t* block);
+
+#endif
@@ -0,0 +1,259 @@
+// Offline texture cooker. Reads the materials of the given models and writes a block compressed, fully mipmapped
+// DDS next to every texture they use, which the renderer loads instead of the source image:
+//   albedo, emission          BC7 (BC1 with --bc1)
+//   normal maps               BC5, the shader rebuilds z
+//   metallic, roughness, AO   BC7
+// usage: texture_cooker [--bc1] [--force] model.gltf...
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <stb_image.h>
+
+#include "bc_encoder.h"
+#include "graphics/dds.h"
+
+enum class TextureRole {
+    COLOR,
+    DATA,
+    NORMAL,
+};
+
+struct Image {
+    int width;
+    int height;
+    std::vector<float> texels;
+};
+
+// 2x2 box filter, odd sizes repeat their last row / column
+static Image downsample(const Image& source, bool normalize)
+{
+    Image target;
+    target.width = std::max(source.width / 2, 1);
+    target.height = std::max(source.height / 2, 1);
+    target.texels.resize(static_cast<size_t>(target.width) * target.height * 4);
+
+    for (int y = 0; y < target.height; y++) {
+        for (int x = 0; x < target.width; x++) {
+            float sum[4] = {};
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    int sx = std::min(x * 2 + dx, source.width - 1);
+                    int sy = std::min(y * 2 + dy, source.height - 1);
+                    const float* texel = &source.texels[(static_cast<size_t>(sy) * source.width + sx) * 4];
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += texel[c] * 0.25f;
+                }
+            }
+
+            // averaged normals get shorter, rescale them around the 0.5 bias
+            if (normalize) {
+                float n[3] = { sum[0] * 2.0f - 1.0f, sum[1] * 2.0f - 1.0f, sum[2] * 2.0f - 1.0f };
+                float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (length > 1e-6f) {
+                    for (int c = 0; c < 3; c++)
+                        sum[c] = n[c] / length * 0.5f + 0.5f;
+                }
+            }
+
+            float* texel = &target.texels[(static_cast<size_t>(y) * target.width + x) * 4];
+            for (int c = 0; c < 4; c++)
+                texel[c] = sum[c];
+        }
+    }
+    return target;
+}
+
+static void encodeLevel(const Image& image, uint32_t format, std::vector<uint8_t>& output)
+{
+    int blocksX = (image.width + 3) / 4;
+    int blocksY = (image.height + 3) / 4;
+    uint32_t blockSize = getDDSBlockSize(format);
+
+    size_t start = output.size();
+    output.resize(start + static_cast<size_t>(blocksX) * blocksY * blockSize);
+    uint8_t* block = output.data() + start;
+
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++, block += blockSize) {
+            // edge blocks repeat the last texel
+            uint8_t texels[64];
+            for (int i = 0; i < 16; i++) {
+                int x = std::min(bx * 4 + i % 4, image.width - 1);
+                int y = std::min(by * 4 + i / 4, image.height - 1);
+                const float* texel = &image.texels[(static_cast<size_t>(y) * image.width + x) * 4];
+                for (int c = 0; c < 4; c++)
+                    texels[i * 4 + c] = static_cast<uint8_t>(std::clamp(texel[c] * 255.0f + 0.5f, 0.0f, 255.0f));
+            }
+
+            if (format == DXGI_FORMAT_BC1_UNORM)
+                encodeBC1(texels, block);
+            else if (format == DXGI_FORMAT_BC5_UNORM)
+                encodeBC5(texels, block);
+            else
+                encodeBC7(texels, block);
+        }
+    }
+}
+
+static bool cookTexture(const std::string& sourcePath, const std::string& targetPath, uint32_t format, bool isNormalMap)
+{
+    int width, height, components;
+    unsigned char* pixels = stbi_load(sourcePath.c_str(), &width, &height, &components, 4);
+    if (!pixels) {
+        printf("failed to load %s: %s\n", sourcePath.c_str(), stbi_failure_reason());
+        return false;
+    }
+
+    Image image { width, height, std::vector<float>(static_cast<size_t>(width) * height * 4) };
+    bool hasAlpha = false;
+    for (size_t i = 0; i < image.texels.size(); i++) {
+        image.texels[i] = pixels[i] / 255.0f;
+        hasAlpha |= i % 4 == 3 && pixels[i] < 255;
+    }
+    stbi_image_free(pixels);
+
+    // BC1 has no alpha here (four color mode only), cutouts keep BC7
+    if (format == DXGI_FORMAT_BC1_UNORM && hasAlpha)
+        format = DXGI_FORMAT_BC7_UNORM;
+
+    std::vector<uint8_t> blocks;
+    uint32_t mipCount = 0;
+    size_t topLevelSize = 0;
+    while (true) {
+        encodeLevel(image, format, blocks);
+        if (mipCount++ == 0)
+            topLevelSize = blocks.size();
+        if (image.width == 1 && image.height == 1)
+            break;
+        image = downsample(image, isNormalMap);
+    }
+
+    DDSHeader header = {};
+    header.size = sizeof(DDSHeader);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.height = height;
+    header.width = width;
+    header.pitchOrLinearSize = static_cast<uint32_t>(topLevelSize);
+    header.mipMapCount = mipCount;
+    header.pixelFormat.size = sizeof(DDSPixelFormat);
+    header.pixelFormat.flags = DDPF_FOURCC;
+    header.pixelFormat.fourCC = DDS_FOURCC_DX10;
+    header.caps = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+
+    DDSHeaderDX10 headerDX10 = {};
+    headerDX10.dxgiFormat = format;
+    headerDX10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+    headerDX10.arraySize = 1;
+
+    std::ofstream stream(targetPath, std::ios::binary | std::ios::trunc);
+    uint32_t magic = DDS_MAGIC;
+    stream.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(&headerDX10), sizeof(headerDX10));
+    stream.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+    if (!stream) {
+        printf("failed to write %s\n", targetPath.c_str());
+        return false;
+    }
+
+    size_t sourceBytes = static_cast<size_t>(width) * height * (components == 3 ? 4 : components) * 4 / 3;
+    printf("%s: %dx%d, %u mips, %.1f MB -> %.1f MB\n", targetPath.c_str(), width, height, mipCount,
+        sourceBytes / (1024.0 * 1024.0), blocks.size() / (1024.0 * 1024.0));
+    return true;
+}
+
+// every texture a model's materials use, with the role deciding its format
+static std::map<std::string, TextureRole> collectTextures(const std::string& modelPath)
+{
+    std::map<std::string, TextureRole> textures;
+
+    Assimp::Importer import;
+    const aiScene* scene = import.ReadFile(modelPath, 0);
+    if (!scene) {
+        printf("failed to load %s: %s\n", modelPath.c_str(), import.GetErrorString());
+        return textures;
+    }
+
+    std::string directory = modelPath.substr(0, modelPath.find_last_of('/'));
+    const std::pair<aiTextureType, TextureRole> slots[] = {
+        { aiTextureType_DIFFUSE, TextureRole::COLOR },
+        { aiTextureType_EMISSIVE, TextureRole::COLOR },
+        { aiTextureType_METALNESS, TextureRole::DATA },
+        { aiTextureType_DIFFUSE_ROUGHNESS, TextureRole::DATA },
+        { aiTextureType_LIGHTMAP, TextureRole::DATA },
+        { aiTextureType_NORMALS, TextureRole::NORMAL },
+    };
+
+    for (unsigned int m = 0; m < scene->mNumMaterials; m++) {
+        const aiMaterial* material = scene->mMaterials[m];
+        for (const auto& [type, role] : slots) {
+            for (unsigned int i = 0; i < material->GetTextureCount(type); i++) {
+                aiString path;
+                material->GetTexture(type, i, &path);
+                // a texture used as a normal map anywhere must stay one
+                TextureRole& stored = textures.try_emplace(directory + '/' + path.C_Str(), role).first->second;
+                stored = std::max(stored, role);
+            }
+        }
+    }
+    return textures;
+}
+
+// same as getCookedTexturePath() in the renderer
+static std::string getCookedPath(const std::string& path)
+{
+    return std::filesystem::path(path).replace_extension(".dds").generic_string();
+}
+
+int main(int argc, char** argv)
+{
+    bool useBC1 = false;
+    bool force = false;
+    std::vector<std::string> models;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--bc1")
+            useBC1 = true;
+        else if (argument == "--force")
+            force = true;
+        else
+            models.push_back(argument);
+    }
+
+    if (models.empty()) {
+        printf("usage: texture_cooker [--bc1] [--force] model.gltf...\n");
+        return 1;
+    }
+
+    int failed = 0;
+    for (const std::string& model : models) {
+        for (const auto& [path, role] : collectTextures(model)) {
+            std::string target = getCookedPath(path);
+
+            std::error_code error;
+            if (!force && std::filesystem::exists(target, error)
+                && std::filesystem::last_write_time(target, error) >= std::filesystem::last_write_time(path, error)) {
+                continue;
+            }
+
+            uint32_t format = DXGI_FORMAT_BC7_UNORM;
+            if (role == TextureRole::NORMAL)
+                format = DXGI_FORMAT_BC5_UNORM;
+            else if (role == TextureRole::COLOR && useBC1)
+                format = DXGI_FORMAT_BC1_UNORM;
+
+            if (!cookTexture(path, target, format, role == TextureRole::NORMAL))
+                failed++;
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}